@@ -3,9 +3,20 @@
  * Copyright (C) 2024  dbstream
  */
 #include <VKFW/event.h>
+#include <VKFW/logging.h>
+#include <VKFW/options.h>
+#include <VKFW/platform.h>
+#include <VKFW/ring.h>
+#include <VKFW/vector.h>
 #include <VKFW/vkfw.h>
 #include <VKFW/window_api.h>
 #include <VKFW/window.h>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <string.h>
+#include <system_error>
+#include <thread>
 
 extern "C"
 VKFWAPI void
@@ -27,97 +38,908 @@ vkfwSetEventHandler (VKFWeventhandler handler, void *user)
 	return old;
 }
 
+extern "C"
+VKFWAPI VKFWeventhandler
+vkfwSetWindowEventHandler (VKFWwindow *handle, VKFWeventhandler handler, void *user)
+{
+	VKFWeventhandler old = handle->event_handler;
+	handle->event_handler = handler;
+	handle->event_user = user;
+	return old;
+}
+
+extern "C"
+VKFWAPI VkResult
+vkfwSetWindowEventRouting (VKFWwindow *handle, bool enable)
+{
+	if (enable && !handle->queue.load (std::memory_order_relaxed)) {
+		VKFWwindowqueue *queue = new (std::nothrow) VKFWwindowqueue;
+		if (!queue)
+			return VK_ERROR_OUT_OF_HOST_MEMORY;
+		handle->queue.store (queue, std::memory_order_release);
+	}
+
+	handle->routed.store (enable, std::memory_order_release);
+	return VK_SUCCESS;
+}
+
+extern "C"
+VKFWAPI uint32_t
+vkfwDispatchWindowEvents (VKFWwindow *handle, VKFWeventhandler handler, void *user)
+{
+	VKFWwindowqueue *queue = handle->queue.load (std::memory_order_acquire);
+	if (!queue)
+		return 0;
+
+	uint32_t n = 0;
+	VKFWevent e;
+	while (!(handle->flags & VKFW_WINDOW_DELETED) && queue->pop (&e)) {
+		handler (&e, user);
+		n++;
+	}
+	return n;
+}
+
+/**
+ * pending_events holds events that have been delivered, but not yet handed to
+ * the application. It is only filled while the application is inside
+ * vkfwGetEvents; what doesn't fit in the array of the application is returned
+ * by the next call to vkfwGetEvents, or delivered by the next call to
+ * vkfwDispatchEvents.
+ *
+ * Every queued event holds a reference to its window. pop_event hands that
+ * reference to the caller, which drops it with release_event once the event
+ * has been delivered. Events for windows that were destroyed while the event
+ * was queued are silently dropped.
+ */
+static VKFWring<VKFWevent, 1024> pending_events;
+
+/**
+ * Non-zero while vkfwGetEvents is dispatching events on behalf of the
+ * application.
+ */
+static int collecting_events;
+
+static bool pending_events_overflowed;
+
+/**
+ * True on the input thread, see below.
+ */
+static thread_local bool on_input_thread;
+
+/**
+ * True on the thread that called vkfwInit. Events are only delivered on
+ * this thread, see below.
+ */
+static thread_local bool on_main_thread;
+
 void
-vkfwSendEventToApplication (VKFWevent *e)
+vkfwInitEvents (void)
+{
+	on_main_thread = true;
+}
+
+template <uint32_t N>
+static bool
+push_event (VKFWring<VKFWevent, N> &q, const VKFWevent *e)
+{
+	if (e->window)
+		vkfwRefWindow (e->window);
+
+	if (q.push (*e))
+		return true;
+
+	if (e->window)
+		vkfwUnrefWindow (e->window);
+	return false;
+}
+
+template <uint32_t N>
+static bool
+pop_event (VKFWring<VKFWevent, N> &q, VKFWevent *e)
 {
+	while (q.pop (e)) {
+		if (!e->window || !(e->window->flags & VKFW_WINDOW_DELETED))
+			return true;
+
+		vkfwUnrefWindow (e->window);
+	}
+
+	return false;
+}
+
+static void
+release_event (VKFWevent *e)
+{
+	if (e->window)
+		vkfwUnrefWindow (e->window);
+}
+
+static void
+route_event (VKFWevent *e)
+{
+	VKFWwindow *window = e->window;
+	VKFWwindowqueue *queue = window->queue.load (std::memory_order_acquire);
+	if (queue->push (*e)) {
+		window->queue_overflowed = false;
+		return;
+	}
+
+	if (!window->queue_overflowed) {
+		vkfwPrintf (VKFW_LOG_CORE, "VKFW: window event queue is full; dropping events\n");
+		window->queue_overflowed = true;
+	}
+}
+
+static void
+deliver_event (VKFWevent *e)
+{
+	if (e->window && e->window->routed.load (std::memory_order_acquire)) {
+		route_event (e);
+		return;
+	}
+
+	if (e->window && e->window->event_handler && !collecting_events) {
+		e->window->event_handler (e, e->window->event_user);
+		return;
+	}
+
+	if (!collecting_events) {
+		if (user_event_handler)
+			user_event_handler (e, user_event_pointer);
+		return;
+	}
+
+	if (push_event (pending_events, e)) {
+		pending_events_overflowed = false;
+		return;
+	}
+
+	if (!pending_events_overflowed) {
+		vkfwPrintf (VKFW_LOG_CORE, "VKFW: event queue is full; dropping events\n");
+		pending_events_overflowed = true;
+	}
+}
+
+/**
+ * Event coalescing: an event which may be coalesced is held back until an
+ * event arrives that cannot be merged into it, or until the backend reaches
+ * the end of a batch of events and calls vkfwFlushEvents.
+ */
+static VKFWevent held_event;
+static bool has_held_event;
+
+static unsigned int
+coalesce_flag (int type)
+{
+	switch (type) {
+	case VKFW_EVENT_POINTER_MOTION:
+		return VKFW_COALESCE_POINTER_MOTION;
+	case VKFW_EVENT_RELATIVE_POINTER_MOTION:
+		return VKFW_COALESCE_RELATIVE_POINTER_MOTION;
+	case VKFW_EVENT_SCROLL:
+		return VKFW_COALESCE_SCROLL;
+	case VKFW_EVENT_WINDOW_RESIZE_NOTIFY:
+		return VKFW_COALESCE_RESIZE;
+	default:
+		return 0;
+	}
+}
+
+static bool
+merge_held_event (const VKFWevent *e)
+{
+	if (e->type != held_event.type || e->window != held_event.window)
+		return false;
+
 	switch (e->type) {
+	case VKFW_EVENT_POINTER_MOTION:
 	case VKFW_EVENT_WINDOW_RESIZE_NOTIFY:
+		held_event = *e;
+		return true;
+	case VKFW_EVENT_RELATIVE_POINTER_MOTION:
+		held_event.x += e->x;
+		held_event.y += e->y;
+		held_event.modifiers = e->modifiers;
+		return true;
+	case VKFW_EVENT_SCROLL:
+		if (e->scroll_direction != held_event.scroll_direction)
+			return false;
+		held_event.scroll_value += e->scroll_value;
+		held_event.x = e->x;
+		held_event.y = e->y;
+		held_event.modifiers = e->modifiers;
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void
+flush_held_event (void)
+{
+	if (!has_held_event)
+		return;
+
+	has_held_event = false;
+	if (!(held_event.window->flags & VKFW_WINDOW_DELETED))
+		deliver_event (&held_event);
+	vkfwUnrefWindow (held_event.window);
+}
+
+static void drain_input_events (void);
+
+void
+vkfwFlushEvents (void)
+{
+	/**
+	 * Other threads publish events as they are translated; the main
+	 * thread flushes them after draining input_events.
+	 */
+	if (!on_main_thread)
+		return;
+
+	drain_input_events ();
+	flush_held_event ();
+
+	if (vkfwCurrentPlatform->dispatchWaitFds)
+		vkfwCurrentPlatform->dispatchWaitFds ();
+}
+
+extern "C"
+VKFWAPI void
+vkfwSetEventCoalescing (VKFWwindow *handle, unsigned int flags)
+{
+	handle->coalesce_flags = flags;
+	if (has_held_event && held_event.window == handle
+		&& !(flags & coalesce_flag (held_event.type)))
+		flush_held_event ();
+}
+
+static bool
+event_wanted (const VKFWevent *e)
+{
+	return !e->window || (e->window->event_mask & VKFW_EVENT_BIT (e->type));
+}
+
+/**
+ * The part of vkfwSendEventToApplication that depends on backend state. This
+ * runs with vkfw_input_mu held. Returns false if the window doesn't want the
+ * event.
+ */
+static bool
+translate_event (VKFWevent *e)
+{
+	/**
+	 * Keep window->extent up to date for vkfwGetFramebufferExtent,
+	 * whether or not the window wants the event.
+	 */
+	if (e->type == VKFW_EVENT_WINDOW_RESIZE_NOTIFY)
+		e->window->extent.store (e->extent, std::memory_order_relaxed);
+
+	if (!event_wanted (e)) {
 		/**
-		 * Keep window->extent up to date.
+		 * Losing focus releases all keys, even if the application
+		 * doesn't want to hear about it.
 		 */
-		e->window->extent = e->extent;
-		break;
+		if (e->type == VKFW_EVENT_WINDOW_LOST_FOCUS)
+			vkfwClearKeyState (e->window);
+		return false;
+	}
+
+	switch (e->type) {
 	case VKFW_EVENT_KEY_PRESSED:
 	case VKFW_EVENT_KEY_RELEASED:
-		e->key = vkfwTranslateKeycode (e->keycode);
+		e->key = VKFW_KEY_UNKNOWN;
+		if (vkfwCurrentWindowBackend->translate_keycode)
+			e->key = vkfwCurrentWindowBackend->translate_keycode (e->keycode);
 		break;
 	}
 
-	if (user_event_handler)
-		user_event_handler (e, user_event_pointer);
+	/**
+	 * The key state is updated here, rather than when the event is
+	 * delivered, so that it doesn't lag behind the window system while
+	 * events are queued.
+	 */
+	if (e->window)
+		vkfwUpdateKeyState (e);
+	return true;
+}
+
+/**
+ * The part of vkfwSendEventToApplication that runs on the application
+ * thread, without vkfw_input_mu held.
+ */
+static void
+send_translated_event (VKFWevent *e)
+{
+	if (has_held_event) {
+		if (merge_held_event (e))
+			return;
+		flush_held_event ();
+	}
+
+	if (e->window && (e->window->coalesce_flags & coalesce_flag (e->type))) {
+		vkfwRefWindow (e->window);
+		held_event = *e;
+		has_held_event = true;
+		return;
+	}
+
+	deliver_event (e);
+}
+
+/**
+ *   Translation and delivery.
+ *
+ * Events are read and translated with vkfw_input_mu held, by whichever thread
+ * reads from the window system, and published in input_events. The main
+ * thread delivers them in vkfwFlushEvents, which the backend calls without
+ * the lock at the end of every batch. This way event handlers never run with
+ * the lock held, and other threads only wait for the lock while a batch of
+ * events is being translated.
+ *
+ * With the input_thread option, a dedicated thread reads and translates
+ * events. The application thread only drains input_events in
+ * vkfwDispatchEvents and vkfwGetEvents, so a long frame does not delay
+ * reading from the window system. Other threads may read events too, for
+ * example when a window function does a Wayland roundtrip.
+ *
+ * Events that the backend queues with vkfwQueueEvent while translating
+ * another event are staged in input_staged, and published right after the
+ * event that caused them.
+ *
+ * vkfw_input_mu serializes the producers of both rings; the main thread is
+ * the only consumer of input_events.
+ */
+std::mutex vkfw_input_mu;
+
+static VKFWring<VKFWevent, 1024> input_events;
+static VKFWring<VKFWevent, 64> input_staged;
+
+static std::thread input_thread;
+static bool input_thread_running;
+static std::atomic<bool> input_thread_stop;
+static std::atomic<VkResult> input_thread_result;
+
+static bool input_events_overflowed;
+
+static void
+publish_input_event (VKFWevent *e)
+{
+	/**
+	 * Don't block when input_events is full: the application thread may
+	 * be waiting for vkfw_input_mu, which we are holding. On the
+	 * application thread, backends stop translating before this happens,
+	 * see vkfwEventQueueFull.
+	 */
+	bool ok = true;
+	if (translate_event (e))
+		ok = push_event (input_events, e);
+
+	VKFWevent staged;
+	while (input_staged.pop (&staged)) {
+		if (ok && input_events.push (staged))
+			continue;
+
+		ok = false;
+		if (staged.window)
+			vkfwUnrefWindow (staged.window);
+	}
+
+	if (ok) {
+		input_events_overflowed = false;
+		return;
+	}
+
+	if (!input_events_overflowed) {
+		vkfwPrintf (VKFW_LOG_CORE, "VKFW: input event queue is full; dropping events\n");
+		input_events_overflowed = true;
+	}
+}
+
+/**
+ * Read and translate one event with get_event. e->type is VKFW_EVENT_NONE
+ * if the backend had nothing to return.
+ */
+static VkResult
+poll_compat_event (VKFWevent *e)
+{
+	e->type = VKFW_EVENT_NONE;
+	e->window = nullptr;
+	if (!vkfwCurrentWindowBackend->get_event)
+		return VK_SUCCESS;
+
+	std::scoped_lock g (vkfw_input_mu);
+	VkResult result = vkfwCurrentWindowBackend->get_event (e, VKFW_EVENT_MODE_POLL, 0);
+	if (result == VK_SUCCESS && e->type != VKFW_EVENT_NONE && e->type != VKFW_EVENT_NULL)
+		vkfwSendEventToApplication (e);
+	return result;
 }
 
 static VkResult
-get_compat_event (VKFWevent *e, uint64_t deadline);
+read_input_events (void)
+{
+	if (vkfwCurrentWindowBackend->dispatch_events)
+		return vkfwCurrentWindowBackend->dispatch_events (VKFW_EVENT_MODE_POLL, 0);
+
+	VKFWevent e;
+	do {
+		VkResult result = poll_compat_event (&e);
+		if (result != VK_SUCCESS)
+			return result;
+	} while (e.type != VKFW_EVENT_NONE);
+	return VK_SUCCESS;
+}
+
+static void
+input_thread_main (void)
+{
+	on_input_thread = true;
+
+	while (!input_thread_stop.load (std::memory_order_acquire)) {
+		VkResult result = vkfwCurrentWindowBackend->wait_input ();
+		if (result == VK_SUCCESS)
+			result = read_input_events ();
+
+		if (result != VK_SUCCESS) {
+			vkfwPrintf (VKFW_LOG_CORE, "VKFW: input thread stopped with error %d\n", result);
+			input_thread_result.store (result, std::memory_order_release);
+			vkfwCurrentPlatform->postEmptyEvent ();
+			return;
+		}
+
+		/**
+		 * Wake up the application thread once per batch of events.
+		 */
+		if (!input_events.empty ())
+			vkfwCurrentPlatform->postEmptyEvent ();
+	}
+}
+
+void
+vkfwStartInputThread (void)
+{
+	if (!vkfwGetBool ("input_thread"))
+		return;
+
+	if (!vkfwCurrentWindowBackend->init_input_thread
+		|| !vkfwCurrentWindowBackend->cancel_input_thread
+		|| !vkfwCurrentPlatform->postEmptyEvent
+		|| !vkfwCurrentPlatform->waitUntil) {
+		vkfwPrintf (VKFW_LOG_CORE, "VKFW: input_thread is not supported by the current backend\n");
+		return;
+	}
+
+	if (vkfwCurrentWindowBackend->init_input_thread () != VK_SUCCESS) {
+		vkfwPrintf (VKFW_LOG_CORE, "VKFW: failed to initialize the input thread\n");
+		return;
+	}
+
+	input_thread_result.store (VK_SUCCESS, std::memory_order_relaxed);
+	input_thread_stop.store (false, std::memory_order_relaxed);
+	try {
+		input_thread = std::thread (input_thread_main);
+	} catch (const std::system_error &) {
+		vkfwPrintf (VKFW_LOG_CORE, "VKFW: failed to start the input thread\n");
+		vkfwCurrentWindowBackend->cancel_input_thread ();
+		return;
+	}
+
+	input_thread_running = true;
+}
+
+void
+vkfwStopInputThread (void)
+{
+	if (!input_thread_running)
+		return;
+
+	input_thread_stop.store (true, std::memory_order_release);
+	vkfwCurrentWindowBackend->wake_input_thread ();
+	input_thread.join ();
+	input_thread_running = false;
+}
+
+void
+vkfwSendEventToApplication (VKFWevent *e)
+{
+	publish_input_event (e);
+
+	/**
+	 * The input thread wakes up the main thread once per batch, and the
+	 * main thread flushes its own events at the end of the batch.
+	 */
+	if (!on_main_thread && !on_input_thread && vkfwCurrentPlatform->postEmptyEvent)
+		vkfwCurrentPlatform->postEmptyEvent ();
+}
+
+void
+vkfwQueueEvent (VKFWevent *e)
+{
+	if (!event_wanted (e))
+		return;
+
+	if (!push_event (input_staged, e))
+		vkfwPrintf (VKFW_LOG_CORE, "VKFW: deferred event queue is full; dropping event type %d\n",
+			e->type);
+}
+
+/**
+ * Append UTF-8 text to the text buffer of a window. Text that doesn't fit is
+ * dropped; the application is expected to drain the buffer every frame.
+ *
+ * The buffer is a byte ring like VKFWring: this side only advances text_tail,
+ * and vkfwGetTextInput only advances text_head.
+ */
+static void
+append_text (VKFWwindow *window, const char *text, size_t len)
+{
+	uint32_t tail = window->text_tail.load (std::memory_order_relaxed);
+	uint32_t used = tail - window->text_head.load (std::memory_order_acquire);
+	if (len > VKFW_TEXT_BUFFER_SIZE - used) {
+		if (!window->text_overflowed)
+			vkfwPrintf (VKFW_LOG_CORE, "VKFW: text input buffer is full; dropping text\n");
+		window->text_overflowed = true;
+		return;
+	}
+
+	uint32_t i = tail & (VKFW_TEXT_BUFFER_SIZE - 1);
+	size_t n = len < VKFW_TEXT_BUFFER_SIZE - i ? len : VKFW_TEXT_BUFFER_SIZE - i;
+	memcpy (window->text + i, text, n);
+	memcpy (window->text, text + n, len - n);
+
+	window->text_tail.store (tail + len, std::memory_order_release);
+	window->text_overflowed = false;
+}
+
+static size_t
+encode_utf8 (char *out, uint32_t c)
+{
+	if (c < 0x80) {
+		out[0] = c;
+		return 1;
+	} else if (c < 0x800) {
+		out[0] = 0xc0 | (c >> 6);
+		out[1] = 0x80 | (c & 0x3f);
+		return 2;
+	} else if (c < 0x10000) {
+		out[0] = 0xe0 | (c >> 12);
+		out[1] = 0x80 | ((c >> 6) & 0x3f);
+		out[2] = 0x80 | (c & 0x3f);
+		return 3;
+	} else if (c < 0x110000) {
+		out[0] = 0xf0 | (c >> 18);
+		out[1] = 0x80 | ((c >> 12) & 0x3f);
+		out[2] = 0x80 | ((c >> 6) & 0x3f);
+		out[3] = 0x80 | (c & 0x3f);
+		return 4;
+	}
+	return 0;
+}
+
+/**
+ * Decode one codepoint from well-formed UTF-8, and return its length.
+ */
+static size_t
+decode_utf8 (const char *in, size_t len, uint32_t *c)
+{
+	unsigned char b = in[0];
+	size_t n = b < 0x80 ? 1 : b < 0xe0 ? 2 : b < 0xf0 ? 3 : 4;
+	if (n > len)
+		return 0;
+
+	*c = n == 1 ? b : n == 2 ? (b & 0x1f) : n == 3 ? (b & 0x0f) : (b & 0x07);
+	for (size_t i = 1; i < n; i++)
+		*c = (*c << 6) | (in[i] & 0x3f);
+	return n;
+}
+
+void
+vkfwQueueTextInputEvent (VKFWwindow *window, uint32_t codepoint,
+	int x, int y, unsigned int mods)
+{
+	if (!(window->flags & VKFW_WINDOW_TEXT_INPUT_ENABLED))
+		return;
+
+	if (window->flags & VKFW_WINDOW_TEXT_INPUT_BUFFERED) {
+		char buf[4];
+		append_text (window, buf, encode_utf8 (buf, codepoint));
+		return;
+	}
+
+	if (!(window->event_mask & VKFW_EVENT_BIT (VKFW_EVENT_TEXT_INPUT)))
+		return;
+
+	VKFWevent e {};
+	e.type = VKFW_EVENT_TEXT_INPUT;
+	e.window = window;
+	e.x = x;
+	e.y = y;
+	e.codepoint = codepoint;
+	e.modifiers = mods;
+	vkfwQueueEvent (&e);
+}
+
+void
+vkfwQueueTextInput (VKFWwindow *window, const char *text, size_t len,
+	int x, int y, unsigned int mods)
+{
+	if (!(window->flags & VKFW_WINDOW_TEXT_INPUT_ENABLED))
+		return;
+
+	if (window->flags & VKFW_WINDOW_TEXT_INPUT_BUFFERED) {
+		append_text (window, text, len);
+		return;
+	}
+
+	uint32_t codepoint;
+	while (len) {
+		size_t n = decode_utf8 (text, len, &codepoint);
+		if (!n)
+			break;
+
+		vkfwQueueTextInputEvent (window, codepoint, x, y, mods);
+		text += n;
+		len -= n;
+	}
+}
+
+/**
+ * Set by vkfwPostEmptyEvent, consumed by the dispatch loop that it wakes up.
+ */
+static std::atomic<bool> empty_event_posted;
 
 extern "C"
-VKFWAPI VkResult
-vkfwDispatchEvents (int mode, uint64_t timeout)
+VKFWAPI void
+vkfwPostEmptyEvent (void)
 {
-	if (mode == VKFW_EVENT_MODE_POLL)
-		timeout = 0;
+	empty_event_posted.store (true, std::memory_order_release);
+	if (vkfwCurrentPlatform->postEmptyEvent)
+		vkfwCurrentPlatform->postEmptyEvent ();
+}
 
-	if (vkfwCurrentWindowBackend->dispatch_events)
-		return vkfwCurrentWindowBackend->dispatch_events (mode, timeout);
+/**
+ * While collecting events for vkfwGetEvents, there is no point in blocking
+ * once there is something to return.
+ */
+bool
+vkfwShouldStopDispatch (void)
+{
+	if (!on_main_thread)
+		return false;
+
+	if (empty_event_posted.load (std::memory_order_relaxed)
+		&& empty_event_posted.exchange (false, std::memory_order_acquire))
+		return true;
+
+	return collecting_events && !pending_events.empty ();
+}
 
-	if (timeout && mode == VKFW_EVENT_MODE_TIMEOUT)
+/**
+ * Delivering one event from input_events can also deliver the event that is
+ * held back for coalescing, so leave room for both.
+ */
+static bool
+pending_events_full (void)
+{
+	return collecting_events && pending_events.size () + 2 > pending_events.capacity ();
+}
+
+bool
+vkfwEventQueueFull (void)
+{
+	if (!on_main_thread)
+		return false;
+
+	return input_events.size () + input_staged.capacity () >= input_events.capacity ()
+		|| pending_events_full ();
+}
+
+/**
+ * The backend is polled with vkfw_input_mu held, and we wait for it without
+ * the lock.
+ */
+static VkResult
+dispatch_compat_events (int mode, uint64_t timeout)
+{
+	if (timeout && timeout != UINT64_MAX && mode == VKFW_EVENT_MODE_TIMEOUT)
 		timeout += vkfwGetTime ();
 
-	VkResult result;
 	VKFWevent e;
 	for (;;) {
-		for (;;) {
-			e.type = VKFW_EVENT_NONE;
-			e.window = nullptr;
+		do {
+			if (vkfwEventQueueFull ()) {
+				vkfwFlushEvents ();
+				if (vkfwEventQueueFull ())
+					return VK_SUCCESS;
+			}
 
-			result = get_compat_event (&e, timeout);
+			VkResult result = poll_compat_event (&e);
 			if (result != VK_SUCCESS)
 				return result;
+		} while (e.type != VKFW_EVENT_NONE);
 
-			if (e.type == VKFW_EVENT_NONE)
-				break;
-			if (e.type == VKFW_EVENT_NULL)
-				continue;
-			vkfwSendEventToApplication (&e);
-		}
+		/**
+		 * The backend has run out of events; this is the end of a
+		 * batch.
+		 */
+		vkfwFlushEvents ();
 
-		if (!timeout || vkfwGetTime () >= timeout)
+		if (!timeout || vkfwGetTime () >= timeout || vkfwShouldStopDispatch ())
 			return VK_SUCCESS;
+
+		if (vkfwCurrentPlatform->waitUntil)
+			vkfwCurrentPlatform->waitUntil (timeout);
+		else
+			vkfwDelayUntil (timeout);
 	}
 }
 
-static VKFWwindow *text_input_window;
-static uint32_t text_input_codepoint;
-static int text_input_x, text_input_y;
-static unsigned int text_input_mods;
+static void
+drain_input_events (void)
+{
+	VKFWevent e;
+	while (!pending_events_full () && pop_event (input_events, &e)) {
+		if (e.type != VKFW_EVENT_TEXT_INPUT
+			|| (e.window->flags & VKFW_WINDOW_TEXT_INPUT_ENABLED))
+			send_translated_event (&e);
 
-void
-vkfwCleanupEvents (void)
+		release_event (&e);
+	}
+}
+
+static VkResult
+dispatch_input_thread_events (int mode, uint64_t timeout)
 {
-	user_event_handler = nullptr;
+	if (timeout && timeout != UINT64_MAX && mode == VKFW_EVENT_MODE_TIMEOUT)
+		timeout += vkfwGetTime ();
+
+	if (vkfwCurrentWindowBackend->flush)
+		vkfwCurrentWindowBackend->flush ();
+
+	for (;;) {
+		vkfwFlushEvents ();
+
+		VkResult result = input_thread_result.load (std::memory_order_acquire);
+		if (result != VK_SUCCESS)
+			return result;
+
+		if (!timeout || vkfwGetTime () >= timeout || vkfwShouldStopDispatch ()
+			|| pending_events_full ())
+			return VK_SUCCESS;
+
+		/**
+		 * The input thread posts an empty event after publishing a
+		 * batch, so this cannot miss events that arrive after the
+		 * check.
+		 */
+		if (input_events.empty ())
+			vkfwCurrentPlatform->waitUntil (timeout);
+	}
+}
+
+static VkResult
+dispatch_events (int mode, uint64_t timeout)
+{
+	if (mode == VKFW_EVENT_MODE_POLL)
+		timeout = 0;
+
+	/**
+	 * An empty event that was posted while nobody was waiting turns this
+	 * call into a poll. Let the platform drain its wakeup mechanism, so
+	 * that a nested event loop waiting on vkfwGetEventFd does not spin.
+	 */
+	if (empty_event_posted.load (std::memory_order_relaxed)
+		&& empty_event_posted.exchange (false, std::memory_order_acquire)) {
+		mode = VKFW_EVENT_MODE_POLL;
+		timeout = 0;
+		if (vkfwCurrentPlatform->waitUntil)
+			vkfwCurrentPlatform->waitUntil (0);
+	}
+
+	VkResult result;
+	if (input_thread_running)
+		result = dispatch_input_thread_events (mode, timeout);
+	else if (vkfwCurrentWindowBackend->dispatch_events)
+		result = vkfwCurrentWindowBackend->dispatch_events (mode, timeout);
+	else
+		result = dispatch_compat_events (mode, timeout);
+
+	vkfwFlushEvents ();
+	return result;
+}
+
+/**
+ * Windows of the events that were last returned by vkfwGetEvents. Their
+ * references are kept until the application calls back into VKFW to dispatch
+ * more events, so that the windows stay valid while it looks at the events.
+ */
+static VKFWvector<VKFWwindow *> returned_windows;
+
+static void
+release_returned_windows (void)
+{
+	while (returned_windows.size ())
+		vkfwUnrefWindow (returned_windows.pop_back ());
+}
+
+extern "C"
+VKFWAPI VkResult
+vkfwDispatchEvents (int mode, uint64_t timeout)
+{
+	release_returned_windows ();
+
+	/**
+	 * Deliver events that were left over by vkfwGetEvents, the same way
+	 * as if they had just been read.
+	 */
+	VKFWevent e;
+	while (pop_event (pending_events, &e)) {
+		deliver_event (&e);
+		release_event (&e);
+	}
+
+	return dispatch_events (mode, timeout);
+}
+
+extern "C"
+VKFWAPI VkResult
+vkfwGetEvents (uint32_t *count, VKFWevent *events, int mode, uint64_t timeout)
+{
+	VkResult result = VK_SUCCESS;
 
-	if (text_input_window) {
-		vkfwUnrefWindow (text_input_window);
-		text_input_window = nullptr;
+	release_returned_windows ();
+	if (pending_events.size () < *count) {
+		/**
+		 * If we already have something to return, only pick up what
+		 * the backend has available right now.
+		 */
+		if (!pending_events.empty ())
+			mode = VKFW_EVENT_MODE_POLL;
+
+		collecting_events++;
+		result = dispatch_events (mode, timeout);
+		collecting_events--;
+	}
+
+	uint32_t n = 0;
+	while (n < *count && pop_event (pending_events, &events[n])) {
+		/**
+		 * If we can't remember the window, fall back to the reference
+		 * of the application.
+		 */
+		if (events[n].window && !returned_windows.push_back (events[n].window))
+			vkfwUnrefWindow (events[n].window);
+		n++;
 	}
+	*count = n;
+
+	if (result != VK_SUCCESS)
+		return result;
+
+	return pending_events.empty () ? VK_SUCCESS : VK_INCOMPLETE;
 }
 
 void
-vkfwQueueTextInputEvent (VKFWwindow *window, uint32_t codepoint,
-	int x, int y, unsigned int mods)
+vkfwCleanupEvents (void)
 {
-	if (!(window->flags & VKFW_WINDOW_TEXT_INPUT_ENABLED))
-		return;
+	user_event_handler = nullptr;
 
-	if (text_input_window)
-		vkfwUnrefWindow (text_input_window);
+	if (has_held_event) {
+		has_held_event = false;
+		vkfwUnrefWindow (held_event.window);
+	}
+
+	release_returned_windows ();
 
-	vkfwRefWindow (window);
-	text_input_codepoint = codepoint;
-	text_input_x = x;
-	text_input_y = y;
-	text_input_mods = mods;
-	text_input_window = window;
+	VKFWevent e;
+	while (pop_event (pending_events, &e))
+		release_event (&e);
+	while (pop_event (input_staged, &e))
+		release_event (&e);
+	while (pop_event (input_events, &e))
+		release_event (&e);
 }
 
 extern "C"
@@ -125,10 +947,6 @@ VKFWAPI void
 vkfwDisableTextInput (VKFWwindow *handle)
 {
 	handle->flags &= ~VKFW_WINDOW_TEXT_INPUT_ENABLED;
-	if (text_input_window == handle) {
-		vkfwUnrefWindow (text_input_window);
-		text_input_window = nullptr;
-	}
 }
 
 extern "C"
@@ -136,40 +954,46 @@ VKFWAPI void
 vkfwEnableTextInput (VKFWwindow *handle)
 {
 	handle->flags |= VKFW_WINDOW_TEXT_INPUT_ENABLED;
+	if (vkfwCurrentWindowBackend->enable_text_input)
+		vkfwCurrentWindowBackend->enable_text_input (handle);
 }
 
-static bool
-get_queued_event (VKFWevent *e)
-{
-	if (text_input_window) {
-		if (text_input_window->flags & VKFW_WINDOW_DELETED) {
-			vkfwUnrefWindow (text_input_window);
-			text_input_window = nullptr;
-		} else {
-			e->window = text_input_window;
-			e->type = VKFW_EVENT_TEXT_INPUT;
-			e->x = text_input_x;
-			e->y = text_input_y;
-			e->codepoint = text_input_codepoint;
-			e->modifiers = text_input_mods;
-			vkfwUnrefWindow (text_input_window);
-			text_input_window = nullptr;
-			return true;
-		}
-	}
-
-	return false;
+extern "C"
+VKFWAPI void
+vkfwSetTextInputBuffering (VKFWwindow *handle, bool enable)
+{
+	if (enable)
+		handle->flags |= VKFW_WINDOW_TEXT_INPUT_BUFFERED;
+	else
+		handle->flags &= ~VKFW_WINDOW_TEXT_INPUT_BUFFERED;
 }
 
-static VkResult
-get_compat_event (VKFWevent *e, uint64_t deadline)
+extern "C"
+VKFWAPI size_t
+vkfwGetTextInput (VKFWwindow *handle, char *buffer, size_t size)
 {
-	if (get_queued_event (e))
-		return VK_SUCCESS;
+	if (!size)
+		return 0;
 
-	if (vkfwCurrentWindowBackend->get_event)
-		return vkfwCurrentWindowBackend->get_event (e, VKFW_EVENT_MODE_DEADLINE, deadline);
+	const uint32_t mask = VKFW_TEXT_BUFFER_SIZE - 1;
+	uint32_t head = handle->text_head.load (std::memory_order_relaxed);
+	size_t len = handle->text_tail.load (std::memory_order_acquire) - head;
 
-	vkfwDelayUntil (deadline);
-	return VK_SUCCESS;
+	/**
+	 * Don't split a UTF-8 sequence if the buffer is too small.
+	 */
+	if (len > size - 1) {
+		len = size - 1;
+		while (len && (handle->text[(head + len) & mask] & 0xc0) == 0x80)
+			len--;
+	}
+
+	uint32_t i = head & mask;
+	size_t n = len < VKFW_TEXT_BUFFER_SIZE - i ? len : VKFW_TEXT_BUFFER_SIZE - i;
+	memcpy (buffer, handle->text + i, n);
+	memcpy (buffer + n, handle->text, len - n);
+	buffer[len] = 0;
+
+	handle->text_head.store (head + len, std::memory_order_release);
+	return len;
 }
@@ -2,8 +2,10 @@
  * Keyboard layout handling.
  * Copyright (C) 2024  dbstream
  */
+#include <VKFW/event.h>
 #include <VKFW/vkfw.h>
 #include <VKFW/window_api.h>
+#include <VKFW/window.h>
 
 extern "C"
 VKFWAPI int
@@ -22,3 +24,112 @@ vkfwTranslateKey (int key)
 		return vkfwCurrentWindowBackend->translate_key (key);
 	return VKFW_KEY_UNKNOWN;
 }
+
+/**
+ *   Key and button state.
+ *
+ * Every window has a bitmap of pressed keys, keycodes and buttons. Only the
+ * thread that translates events writes to it, so the bits are updated with
+ * relaxed fetch_or/fetch_and and can be read from any thread without taking
+ * any locks.
+ */
+
+static void
+set_bit (std::atomic<uint64_t> *map, int n, bool pressed)
+{
+	uint64_t bit = (uint64_t) 1 << (n % 64);
+	if (pressed)
+		map[n / 64].fetch_or (bit, std::memory_order_relaxed);
+	else
+		map[n / 64].fetch_and (~bit, std::memory_order_relaxed);
+}
+
+static bool
+get_bit (const std::atomic<uint64_t> *map, int n)
+{
+	return (map[n / 64].load (std::memory_order_relaxed) >> (n % 64)) & 1;
+}
+
+void
+vkfwClearKeyState (VKFWwindow *window)
+{
+	for (std::atomic<uint64_t> &v : window->key_state)
+		v.store (0, std::memory_order_relaxed);
+	for (std::atomic<uint64_t> &v : window->keycode_state)
+		v.store (0, std::memory_order_relaxed);
+	window->button_state.store (0, std::memory_order_relaxed);
+}
+
+void
+vkfwUpdateKeyState (const VKFWevent *e)
+{
+	VKFWwindow *window = e->window;
+	bool pressed;
+
+	switch (e->type) {
+	case VKFW_EVENT_KEY_PRESSED:
+	case VKFW_EVENT_KEY_RELEASED:
+		pressed = e->type == VKFW_EVENT_KEY_PRESSED;
+		if (e->key >= 0 && e->key < VKFW_MAX_KEYS)
+			set_bit (window->key_state, e->key, pressed);
+		if (e->keycode >= 0 && e->keycode < VKFW_MAX_KEYCODES)
+			set_bit (window->keycode_state, e->keycode, pressed);
+		break;
+	case VKFW_EVENT_BUTTON_PRESSED:
+	case VKFW_EVENT_BUTTON_RELEASED:
+		pressed = e->type == VKFW_EVENT_BUTTON_PRESSED;
+		if (e->button >= 0 && e->button < VKFW_MAX_BUTTONS) {
+			uint32_t bit = (uint32_t) 1 << e->button;
+			if (pressed)
+				window->button_state.fetch_or (bit, std::memory_order_relaxed);
+			else
+				window->button_state.fetch_and (~bit, std::memory_order_relaxed);
+		}
+		break;
+	case VKFW_EVENT_WINDOW_LOST_FOCUS:
+		/**
+		 * The window won't see the release events for keys that are
+		 * released while it is not focused.
+		 */
+		vkfwClearKeyState (window);
+		break;
+	}
+}
+
+extern "C"
+VKFWAPI bool
+vkfwGetKeyState (VKFWwindow *window, int key)
+{
+	if (key < 0 || key >= VKFW_MAX_KEYS)
+		return false;
+	return get_bit (window->key_state, key);
+}
+
+extern "C"
+VKFWAPI bool
+vkfwGetKeycodeState (VKFWwindow *window, int keycode)
+{
+	if (keycode < 0 || keycode >= VKFW_MAX_KEYCODES)
+		return false;
+	return get_bit (window->keycode_state, keycode);
+}
+
+extern "C"
+VKFWAPI bool
+vkfwGetButtonState (VKFWwindow *window, int button)
+{
+	if (button < 0 || button >= VKFW_MAX_BUTTONS)
+		return false;
+	return (window->button_state.load (std::memory_order_relaxed) >> button) & 1;
+}
+
+extern "C"
+VKFWAPI void
+vkfwGetKeyboardSnapshot (VKFWwindow *window, VKFWkeyboardsnapshot *snapshot)
+{
+	for (int i = 0; i < VKFW_MAX_KEYS / 64; i++)
+		snapshot->keys[i] = window->key_state[i].load (std::memory_order_relaxed);
+	for (int i = 0; i < VKFW_MAX_KEYCODES / 64; i++)
+		snapshot->keycodes[i] = window->keycode_state[i].load (std::memory_order_relaxed);
+	snapshot->buttons = window->button_state.load (std::memory_order_relaxed);
+}
@@ -329,6 +329,7 @@ vkfwInitVersion (uint32_t expected_version)
 		return result;
 	}
 
+	vkfwInitEvents ();
 	vkfwCurrentWindowBackend = vkfwCurrentPlatform->initBackend ();
 	if (!vkfwCurrentWindowBackend) {
 		if (vkfwCurrentPlatform->terminatePlatform)
@@ -390,6 +391,8 @@ vkfwInitVersion (uint32_t expected_version)
 		return VK_ERROR_INITIALIZATION_FAILED;
 	}
 
+	vkfwStartInputThread ();
+
 	init_count++;
 	return VK_SUCCESS;
 }
@@ -410,6 +413,7 @@ vkfwTerminate (void)
 	if (vkfwLoadedInstance)
 		vkfwShutdownInstance ();
 
+	vkfwStopInputThread ();
 	vkfwCleanupEvents ();
 
 	if (vkfwCurrentWindowBackend->close_connection)
@@ -451,3 +455,29 @@ vkfwDelayUntil (uint64_t t)
 			vkfwCurrentPlatform->delay (t - now);
 	}
 }
+
+extern "C"
+VKFWAPI VkResult
+vkfwAddEventFd (int fd, unsigned int events, VKFWfdhandler handler, void *user)
+{
+	if (vkfwCurrentPlatform->addWaitFd)
+		return vkfwCurrentPlatform->addWaitFd (fd, events, handler, user);
+	return VK_ERROR_FEATURE_NOT_PRESENT;
+}
+
+extern "C"
+VKFWAPI void
+vkfwRemoveEventFd (int fd)
+{
+	if (vkfwCurrentPlatform->removeWaitFd)
+		vkfwCurrentPlatform->removeWaitFd (fd);
+}
+
+extern "C"
+VKFWAPI int
+vkfwGetEventFd (void)
+{
+	if (vkfwCurrentPlatform->getWaitFd)
+		return vkfwCurrentPlatform->getWaitFd ();
+	return -1;
+}
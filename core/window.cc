@@ -2,29 +2,66 @@
  * Core window functions.
  * Copyright (C) 2024  dbstream
  */
+#include <VKFW/event.h>
 #include <VKFW/vkfw.h>
 #include <VKFW/window.h>
 #include <VKFW/window_api.h>
 #include <stdlib.h>
+#include <mutex>
+#include <new>
 
 void
 vkfwRefWindow (VKFWwindow *window)
 {
-	window->internal_refcnt++;
+	window->internal_refcnt.fetch_add (1, std::memory_order_relaxed);
 }
 
 void
 vkfwUnrefWindow (VKFWwindow *window)
 {
-	if (--window->internal_refcnt)
+	if (window->internal_refcnt.fetch_sub (1, std::memory_order_acq_rel) != 1)
 		return;
 
+	delete window->queue.load (std::memory_order_relaxed);
+
 	if (vkfwCurrentWindowBackend->free_window)
 		vkfwCurrentWindowBackend->free_window (window);
 	else
 		free (window);
 }
 
+int
+vkfwUpdateWindowVisibility (VKFWwindow *window, int visibility)
+{
+	if (window->visibility.exchange (visibility, std::memory_order_relaxed) == visibility)
+		return VKFW_EVENT_NULL;
+
+	/**
+	 * The events are in the same order as the VKFW_VISIBILITY_* values.
+	 */
+	return VKFW_EVENT_WINDOW_HIDDEN + visibility;
+}
+
+void
+vkfwSendPresentationFeedback (VKFWwindow *window, const VKFWpresentfeedback *feedback)
+{
+	/**
+	 * vkfwGetPresentationFeedback may be taking the oldest entry right
+	 * now, so if the buffer is full, drop the new one instead. The event
+	 * is still sent.
+	 */
+	uint32_t tail = window->feedback_tail.load (std::memory_order_relaxed);
+	if (tail - window->feedback_head.load (std::memory_order_acquire) < VKFW_PRESENT_FEEDBACK_SIZE) {
+		window->feedback[tail % VKFW_PRESENT_FEEDBACK_SIZE] = *feedback;
+		window->feedback_tail.store (tail + 1, std::memory_order_release);
+	}
+
+	VKFWevent e {};
+	e.type = feedback->presented ? VKFW_EVENT_FRAME_PRESENTED : VKFW_EVENT_FRAME_DISCARDED;
+	e.window = window;
+	vkfwSendEventToApplication (&e);
+}
+
 extern "C"
 VKFWAPI VkResult
 vkfwCreateWindow (VKFWwindow **handle, VkExtent2D size)
@@ -39,10 +76,30 @@ vkfwCreateWindow (VKFWwindow **handle, VkExtent2D size)
 		return VK_ERROR_OUT_OF_HOST_MEMORY;
 
 	w->internal_refcnt = 1;
+	w->user = nullptr;
 	w->flags = 0;
 	w->pointer_flags = 0;
+	w->coalesce_flags = 0;
+	w->event_mask = VKFW_EVENT_MASK_ALL;
+	w->visibility = VKFW_VISIBILITY_HIDDEN;
+	w->event_handler = nullptr;
+	w->event_user = nullptr;
+	w->routed = false;
+	w->queue_overflowed = false;
+	w->queue.store (nullptr, std::memory_order_relaxed);
 	w->extent = size;
-	VkResult result = vkfwCurrentWindowBackend->create_window (w);
+	w->text_head = 0;
+	w->text_tail = 0;
+	w->text_overflowed = false;
+	w->feedback_head = 0;
+	w->feedback_tail = 0;
+	vkfwClearKeyState (w);
+
+	VkResult result;
+	{
+		std::scoped_lock g (vkfw_input_mu);
+		result = vkfwCurrentWindowBackend->create_window (w);
+	}
 	if (result != VK_SUCCESS) {
 		vkfwUnrefWindow (w);
 		return result;
@@ -56,8 +113,11 @@ extern "C"
 VKFWAPI void
 vkfwDestroyWindow (VKFWwindow *handle)
 {
-	handle->flags |= VKFW_WINDOW_DELETED;
-	vkfwCurrentWindowBackend->destroy_window (handle);
+	{
+		std::scoped_lock g (vkfw_input_mu);
+		handle->flags |= VKFW_WINDOW_DELETED;
+		vkfwCurrentWindowBackend->destroy_window (handle);
+	}
 	vkfwUnrefWindow (handle);
 }
 
@@ -74,23 +134,21 @@ extern "C"
 VKFWAPI void *
 vkfwSetWindowUserPointer (VKFWwindow *handle, void *user)
 {
-	void *ret = handle->user;
-	handle->user = user;
-	return ret;
+	return handle->user.exchange (user, std::memory_order_acq_rel);
 }
 
 extern "C"
 VKFWAPI void *
 vkfwGetWindowUserPointer (VKFWwindow *handle)
 {
-	return handle->user;
+	return handle->user.load (std::memory_order_acquire);
 }
 
 extern "C"
 VKFWAPI VkExtent2D
 vkfwGetFramebufferExtent (VKFWwindow *handle)
 {
-	return handle->extent;
+	return handle->extent.load (std::memory_order_relaxed);
 }
 
 extern "C"
@@ -120,11 +178,92 @@ vkfwHideWindow (VKFWwindow *handle)
 	return VK_SUCCESS;
 }
 
+extern "C"
+VKFWAPI int
+vkfwGetWindowVisibility (VKFWwindow *handle)
+{
+	return handle->visibility.load (std::memory_order_relaxed);
+}
+
 extern "C"
 VKFWAPI void
 vkfwSetPointerMode (VKFWwindow *handle, unsigned int mode)
 {
-	handle->pointer_flags = mode;
+	handle->pointer_flags.store (mode, std::memory_order_relaxed);
 	if (vkfwCurrentWindowBackend->update_pointer_mode)
 		vkfwCurrentWindowBackend->update_pointer_mode (handle);
 }
+
+extern "C"
+VKFWAPI VkResult
+vkfwRequestFrameCallback (VKFWwindow *handle)
+{
+	if (vkfwCurrentWindowBackend->request_frame)
+		return vkfwCurrentWindowBackend->request_frame (handle);
+	return VK_ERROR_FEATURE_NOT_PRESENT;
+}
+
+extern "C"
+VKFWAPI VkResult
+vkfwRequestPresentationFeedback (VKFWwindow *handle)
+{
+	if (vkfwCurrentWindowBackend->request_presentation_feedback)
+		return vkfwCurrentWindowBackend->request_presentation_feedback (handle);
+	return VK_ERROR_FEATURE_NOT_PRESENT;
+}
+
+extern "C"
+VKFWAPI bool
+vkfwGetPresentationFeedback (VKFWwindow *handle, VKFWpresentfeedback *feedback)
+{
+	uint32_t head = handle->feedback_head.load (std::memory_order_relaxed);
+	if (head == handle->feedback_tail.load (std::memory_order_acquire))
+		return false;
+
+	*feedback = handle->feedback[head % VKFW_PRESENT_FEEDBACK_SIZE];
+	handle->feedback_head.store (head + 1, std::memory_order_release);
+	return true;
+}
+
+extern "C"
+VKFWAPI void
+vkfwAckResize (VKFWwindow *handle)
+{
+	if (vkfwCurrentWindowBackend->ack_resize)
+		vkfwCurrentWindowBackend->ack_resize (handle);
+}
+
+extern "C"
+VKFWAPI void
+vkfwBeginFrame (VKFWwindow *handle)
+{
+	if (vkfwCurrentWindowBackend->begin_frame)
+		vkfwCurrentWindowBackend->begin_frame (handle);
+}
+
+extern "C"
+VKFWAPI uint64_t
+vkfwEndFrame (VKFWwindow *handle)
+{
+	if (vkfwCurrentWindowBackend->end_frame)
+		return vkfwCurrentWindowBackend->end_frame (handle);
+	return 0;
+}
+
+extern "C"
+VKFWAPI bool
+vkfwGetFrameTimings (VKFWwindow *handle, VKFWframetimings *timings)
+{
+	if (vkfwCurrentWindowBackend->get_frame_timings)
+		return vkfwCurrentWindowBackend->get_frame_timings (handle, timings);
+	return false;
+}
+
+extern "C"
+VKFWAPI void
+vkfwSetWindowEventMask (VKFWwindow *handle, unsigned int mask)
+{
+	handle->event_mask.store (mask, std::memory_order_relaxed);
+	if (vkfwCurrentWindowBackend->update_event_mask)
+		vkfwCurrentWindowBackend->update_event_mask (handle);
+}
@@ -0,0 +1,136 @@
+/**
+ * Measure the cost of vkfwDispatchEvents in VKFW_EVENT_MODE_POLL.
+ * Copyright (C) 2024  dbstream
+ *
+ * Usage: dispatch_bench [optstring]
+ *
+ * optstring is passed to vkfwSetOptions. To measure the Wayland backend
+ * without a display, run it against a headless compositor:
+ *
+ *   weston --backend=headless --socket=bench &
+ *   WAYLAND_DISPLAY=bench ./dispatch_bench -enable_xcb
+ *
+ * Two cases are measured. In the idle case, nothing is pending and every call
+ * only checks the connection. In the loaded case, an empty event is posted
+ * before every call, and the window is hidden and shown again every few
+ * calls, so that the window system sends configure events. Only the calls to
+ * vkfwDispatchEvents are timed.
+ */
+#include <VKFW/vkfw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+
+#define ITERATIONS 100000
+#define TOGGLE_INTERVAL 16
+
+static uint64_t samples[ITERATIONS];
+static uint64_t num_events;
+
+static void
+event_handler (VKFWevent *event, void *user)
+{
+	(void) event;
+	(void) user;
+	num_events++;
+}
+
+static uint64_t
+now_ns (void)
+{
+	auto t = std::chrono::steady_clock::now ().time_since_epoch ();
+	return std::chrono::duration_cast<std::chrono::nanoseconds> (t).count ();
+}
+
+static void
+report (const char *name)
+{
+	uint64_t total = 0;
+	for (uint64_t sample : samples)
+		total += sample;
+
+	std::sort (samples, samples + ITERATIONS);
+	printf ("%-7s mean %6llu ns  median %6llu ns  p99 %7llu ns  max %8llu ns  events %llu\n",
+		name, (unsigned long long) (total / ITERATIONS),
+		(unsigned long long) samples[ITERATIONS / 2],
+		(unsigned long long) samples[ITERATIONS * 99 / 100],
+		(unsigned long long) samples[ITERATIONS - 1],
+		(unsigned long long) num_events);
+}
+
+static bool
+run (VKFWwindow *window, bool loaded)
+{
+	bool visible = true;
+
+	num_events = 0;
+	for (int i = 0; i < ITERATIONS; i++) {
+		if (loaded) {
+			vkfwPostEmptyEvent ();
+			if (i % TOGGLE_INTERVAL == 0) {
+				if (visible)
+					vkfwHideWindow (window);
+				else
+					vkfwShowWindow (window);
+				visible = !visible;
+			}
+		}
+
+		uint64_t t0 = now_ns ();
+		VkResult result = vkfwDispatchEvents (VKFW_EVENT_MODE_POLL, 0);
+		samples[i] = now_ns () - t0;
+
+		if (result != VK_SUCCESS) {
+			fprintf (stderr, "vkfwDispatchEvents failed: %d\n", result);
+			return false;
+		}
+	}
+
+	if (!visible)
+		vkfwShowWindow (window);
+	return true;
+}
+
+int
+main (int argc, char **argv)
+{
+	VKFWwindow *window;
+
+	if (argc > 1)
+		vkfwSetOptions (argv[1], 0);
+
+	if (vkfwInit () != VK_SUCCESS) {
+		fprintf (stderr, "vkfwInit failed\n");
+		return 1;
+	}
+
+	vkfwSetEventHandler (event_handler, nullptr);
+
+	if (vkfwCreateWindow (&window, {640, 480}) != VK_SUCCESS) {
+		fprintf (stderr, "vkfwCreateWindow failed\n");
+		vkfwTerminate ();
+		return 1;
+	}
+
+	int status = 1;
+	vkfwShowWindow (window);
+
+	/**
+	 * Let the window system settle, so that the initial configure events
+	 * are not counted towards the idle case.
+	 */
+	vkfwDispatchEvents (VKFW_EVENT_MODE_TIMEOUT, VKFW_SECONDS / 2);
+
+	if (run (window, false)) {
+		report ("idle");
+		if (run (window, true)) {
+			report ("loaded");
+			status = 0;
+		}
+	}
+
+	vkfwDestroyWindow (window);
+	vkfwTerminate ();
+	return status;
+}
@@ -10,15 +10,104 @@
 #define VKFW_EVENT_H 1
 
 #include <VKFW/vkfw.h>
+#include <mutex>
+
+/**
+ * Mark the calling thread as the main thread. This is called by vkfwInit
+ * before the backend is initialized.
+ */
+void
+vkfwInitEvents (void);
 
 void
 vkfwCleanupEvents (void);
 
+/**
+ * The input lock protects backend state that is used to translate events,
+ * such as the window list and keyboard state. Whichever thread reads events
+ * from the window system holds it while translating them, and releases it
+ * before calling vkfwFlushEvents, so event handlers never run with it held.
+ *
+ * The core holds it while creating and destroying windows. Other window
+ * functions leave it to the backend to lock the state that they change.
+ * Per-window state in the core is atomic instead.
+ */
+extern std::mutex vkfw_input_mu;
+
+/**
+ * Start the input thread if the input_thread option is set and the backend
+ * supports it. Failure to start the input thread is not fatal.
+ */
+void
+vkfwStartInputThread (void);
+
+void
+vkfwStopInputThread (void);
+
+/**
+ * Queue an event to be delivered after the event that is currently being
+ * translated by the backend. Called with vkfw_input_mu held, and must be
+ * followed by vkfwSendEventToApplication.
+ */
+void
+vkfwQueueEvent (VKFWevent *e);
+
 void
 vkfwQueueTextInputEvent (VKFWwindow *window, uint32_t codepoint,
 	int x, int y, unsigned int mods);
 
+/**
+ * Queue text input as a UTF-8 string, for input methods and compose
+ * sequences that produce more than one codepoint at once.
+ */
+void
+vkfwQueueTextInput (VKFWwindow *window, const char *text, size_t len,
+	int x, int y, unsigned int mods);
+
+/**
+ * Translate an event and publish it for the main thread. Called with
+ * vkfw_input_mu held.
+ */
 void
 vkfwSendEventToApplication (VKFWevent *e);
 
+/**
+ * Update the key and button state of the window of a translated event. This
+ * is called by vkfwSendEventToApplication.
+ */
+void
+vkfwUpdateKeyState (const VKFWevent *e);
+
+/**
+ * Clear the key and button state of a window.
+ */
+void
+vkfwClearKeyState (VKFWwindow *window);
+
+/**
+ * Deliver the events that have been published, as well as events that are
+ * held back for coalescing. Backends that implement dispatch_events must call
+ * this at the end of every batch of events, before blocking, and without
+ * vkfw_input_mu held.
+ */
+void
+vkfwFlushEvents (void);
+
+/**
+ * Backends that implement dispatch_events should check this between batches
+ * of events and return early if it is true.
+ */
+bool
+vkfwShouldStopDispatch (void);
+
+/**
+ * Backends that implement dispatch_events should stop translating events
+ * when this returns true, and leave the remaining events in their own queue
+ * until they have called vkfwFlushEvents. If it is still true after that,
+ * the application is collecting events for vkfwGetEvents and has no room for
+ * more, so return.
+ */
+bool
+vkfwEventQueueFull (void);
+
 #endif /* VKFW_EVENT_H */
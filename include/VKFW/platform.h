@@ -26,6 +26,25 @@ struct VKFWplatform_T {
 	uint64_t (*getTime) (void);
 	void (*delay) (uint64_t);
 	void (*delayUntil) (uint64_t);
+
+	/**
+	 * The wait set. Backends add their connection fd with a null handler.
+	 * waitUntil blocks until any fd in the wait set is ready, or until the
+	 * absolute deadline has passed (0 means don't block, UINT64_MAX means
+	 * no deadline). It does not call handlers; dispatchWaitFds calls the
+	 * handlers of the fds that were found to be ready.
+	 */
+	VkResult (*addWaitFd) (int, unsigned int, VKFWfdhandler, void *);
+	void (*removeWaitFd) (int);
+	void (*waitUntil) (uint64_t);
+	void (*dispatchWaitFds) (void);
+	int (*getWaitFd) (void);
+
+	/**
+	 * Make a concurrent or future waitUntil return immediately. This is
+	 * called from arbitrary threads.
+	 */
+	void (*postEmptyEvent) (void);
 };
 
 extern VKFWplatform *vkfwCurrentPlatform;
@@ -0,0 +1,77 @@
+/**
+ * Lock-free single-producer single-consumer ring buffer.
+ * Copyright (C) 2024  dbstream
+ *
+ * This is an internal header.
+ */
+#include <VKFW/warn_internal.h>
+
+#ifndef VKFW_RING_H
+#define VKFW_RING_H 1
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * A bounded FIFO queue of POD-type data. One thread may push while another
+ * thread pops; neither side takes a lock. N must be a power of two.
+ *
+ * m_head and m_tail are free-running counters. They are only ever masked
+ * when indexing into m_data, which lets us use the full capacity of the
+ * buffer without a separate "full" flag.
+ */
+template <class T, uint32_t N>
+class VKFWring {
+	static_assert (N && !(N & (N - 1)), "VKFWring size must be a power of two");
+
+	T m_data[N];
+	std::atomic<uint32_t> m_head {0};
+	std::atomic<uint32_t> m_tail {0};
+
+public:
+	bool
+	push (const T &elem)
+	{
+		uint32_t tail = m_tail.load (std::memory_order_relaxed);
+		if (tail - m_head.load (std::memory_order_acquire) >= N)
+			return false;
+
+		m_data[tail & (N - 1)] = elem;
+		m_tail.store (tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool
+	pop (T *out)
+	{
+		uint32_t head = m_head.load (std::memory_order_relaxed);
+		if (head == m_tail.load (std::memory_order_acquire))
+			return false;
+
+		*out = m_data[head & (N - 1)];
+		m_head.store (head + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool
+	empty (void) const
+	{
+		return m_head.load (std::memory_order_acquire)
+			== m_tail.load (std::memory_order_acquire);
+	}
+
+	uint32_t
+	size (void) const
+	{
+		return m_tail.load (std::memory_order_acquire)
+			- m_head.load (std::memory_order_acquire);
+	}
+
+	static constexpr uint32_t
+	capacity (void)
+	{
+		return N;
+	}
+};
+
+#endif /* VKFW_RING_H */
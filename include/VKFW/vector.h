@@ -40,7 +40,7 @@ class VKFWvector {
 			return false;
 
 		if (m_data) {
-			memcpy (new_data, m_data, (size < m_size) ? size : m_size);
+			memcpy (new_data, m_data, ((size < m_size) ? size : m_size) * sizeof (T));
 			delete[] m_data;
 		}
 
@@ -213,6 +213,13 @@ typedef struct VKFWwindow_T VKFWwindow;
 #define VKFW_KEY_NUMPAD_COMMA 314
 #define VKFW_MAX_KEYS 512
 
+/**
+ * Platform keycodes and mouse buttons that are tracked by vkfwGetKeycodeState
+ * and vkfwGetButtonState.
+ */
+#define VKFW_MAX_KEYCODES 256
+#define VKFW_MAX_BUTTONS 32
+
 #define VKFW_MODIFIER_CTRL 1U
 #define VKFW_MODIFIER_SHIFT 2U
 #define VKFW_MODIFIER_LEFT_ALT 4U
@@ -234,6 +241,23 @@ typedef struct VKFWwindow_T VKFWwindow;
 #define VKFW_EVENT_KEY_RELEASED 11
 #define VKFW_EVENT_TEXT_INPUT 12
 #define VKFW_EVENT_RELATIVE_POINTER_MOTION 13
+#define VKFW_EVENT_FRAME_READY 14
+
+/**
+ * Visibility events are sent when the visibility of a window changes, see
+ * vkfwGetWindowVisibility.
+ */
+#define VKFW_EVENT_WINDOW_HIDDEN 15
+#define VKFW_EVENT_WINDOW_SUSPENDED 16
+#define VKFW_EVENT_WINDOW_OCCLUDED 17
+#define VKFW_EVENT_WINDOW_VISIBLE 18
+
+/**
+ * Presentation events are sent for frames that were requested with
+ * vkfwRequestPresentationFeedback, see vkfwGetPresentationFeedback.
+ */
+#define VKFW_EVENT_FRAME_PRESENTED 19
+#define VKFW_EVENT_FRAME_DISCARDED 20
 
 /**
  * VKFW event structure. Adding or removing fields in this struct is an
@@ -328,6 +352,41 @@ struct VKFWevent_T {
 	unsigned int modifiers;
 };
 
+/**
+ * Threading model:
+ *   The main thread is the thread that calls vkfwInit. It must also be the
+ *   thread that dispatches events with vkfwDispatchEvents or vkfwGetEvents,
+ *   and the thread that calls vkfwTerminate. Event handlers are called on the
+ *   main thread, except for vkfwDispatchWindowEvents.
+ *
+ *   Every function in the window management, input and event sections has a
+ *   "thread:" line in its description:
+ *     thread: main   only call this on the main thread
+ *     thread: any    this can be called from any thread, concurrently with
+ *                    any other VKFW function, including event dispatch
+ *     thread: any, but only one thread at a time per window
+ *                    like "any", but calls for the same window must not
+ *                    overlap
+ *   Initialization and Vulkan functions are main thread only, unless noted
+ *   otherwise.
+ *
+ *   A window must not be used by any thread after it is passed to
+ *   vkfwDestroyWindow.
+ *
+ *   Events are read and translated under an internal lock, and delivered
+ *   afterwards without it. Event handlers may call any VKFW function, and
+ *   may wait for other threads that do. Functions that change state which
+ *   is used to translate events take that lock briefly, so they can wait for
+ *   the translation of a batch of events, but never for an event handler.
+ *   Functions that only query or make requests (vkfwGetFramebufferExtent,
+ *   vkfwTranslateKeycode, vkfwGetTextInput, vkfwBeginFrame, ...) don't take
+ *   it.
+ *
+ * note: on Windows, windows belong to the thread that creates them, and
+ * their events are only read on that thread. Create, show, hide and destroy
+ * windows on the main thread there.
+ */
+
 	/* Initialization */
 
 #define VKFW_LOG_CORE 0
@@ -500,18 +559,24 @@ vkfwGetPhysicalDevicePresentSupport (VkPhysicalDevice device, uint32_t queue,
 /**
  * Create a VKFW window. The window will not be shown until vkfwShowWindow is
  * called.
+ *
+ * thread: any
  */
 VKFWAPI VkResult
 vkfwCreateWindow (VKFWwindow **handle, VkExtent2D size);
 
 /**
  * Create a VkSurfaceKHR for a window.
+ *
+ * thread: any
  */
 VKFWAPI VkResult
 vkfwCreateSurface (VKFWwindow *handle, VkSurfaceKHR *out);
 
 /**
  * Destroy a VKFW window.
+ *
+ * thread: any
  */
 VKFWAPI void
 vkfwDestroyWindow (VKFWwindow *handle);
@@ -519,38 +584,84 @@ vkfwDestroyWindow (VKFWwindow *handle);
 /**
  * Set a user pointer in the VKFWwindow. Returns the previous value of
  * the pointer.
+ *
+ * thread: any
  */
 VKFWAPI void *
 vkfwSetWindowUserPointer (VKFWwindow *handle, void *user);
 
 /**
  * Get a user pointer from the VKFWwindow.
+ *
+ * thread: any
  */
 VKFWAPI void *
 vkfwGetWindowUserPointer (VKFWwindow *handle);
 
 /**
  * Set the window title.
+ *
+ * note: on some platforms, window management requests are asynchronous and
+ * are only sent to the window system on the next call to vkfwDispatchEvents.
+ * An error from an earlier request on the same window may be returned by a
+ * later call to vkfwSetWindowTitle, vkfwShowWindow or vkfwHideWindow.
+ *
+ * thread: any
  */
 VKFWAPI VkResult
 vkfwSetWindowTitle (VKFWwindow *handle, const char *title);
 
 /**
  * Show a VKFW window.
+ *
+ * thread: any
  */
 VKFWAPI VkResult
 vkfwShowWindow (VKFWwindow *handle);
 
 /**
  * Hide a VKFW window.
+ *
+ * thread: any
  */
 VKFWAPI VkResult
 vkfwHideWindow (VKFWwindow *handle);
 
+/**
+ * Window visibility, from least to most visible:
+ *   VKFW_VISIBILITY_HIDDEN     the window is not shown at all
+ *   VKFW_VISIBILITY_SUSPENDED  the window is shown, but the window system
+ *                              says it isn't being drawn: it is minimized,
+ *                              or the screen is locked
+ *   VKFW_VISIBILITY_OCCLUDED   the window is fully covered by other windows
+ *   VKFW_VISIBILITY_VISIBLE    at least part of the window may be visible
+ */
+#define VKFW_VISIBILITY_HIDDEN 0
+#define VKFW_VISIBILITY_SUSPENDED 1
+#define VKFW_VISIBILITY_OCCLUDED 2
+#define VKFW_VISIBILITY_VISIBLE 3
+
+/**
+ * Get the visibility of a window, a VKFW_VISIBILITY_*. Like the key state,
+ * this follows the visibility events for the window as they are read from
+ * the window system. Applications can use it to stop drawing, or draw at a
+ * much lower rate, while nobody can see the window.
+ *
+ * note: not every window system reports every state. With a compositing
+ * manager, X11 never reports windows as occluded, and Wayland compositors
+ * report occlusion as suspended, if at all.
+ *
+ * thread: any
+ */
+VKFWAPI int
+vkfwGetWindowVisibility (VKFWwindow *handle);
+
 /**
  * Get the size of the framebuffer for a window.
  * note: it is unnecessary to call this after a WINDOW_RESIZE_NOTIFY; instead,
  * use e->extent.
+ *
+ * thread: any
  */
 VKFWAPI VkExtent2D
 vkfwGetFramebufferExtent (VKFWwindow *handle);
@@ -564,16 +675,262 @@ vkfwGetFramebufferExtent (VKFWwindow *handle);
  *                           leaves the window
  *   VKFW_POINTER_RELATIVE   VKFW_EVENT_RELATIVE_POINTER_MOTION will be
  *                           generated instead of VKFW_EVENT_POINTER_MOTION
+ *
+ * note: on Wayland, VKFW_POINTER_RELATIVE also locks the pointer in place,
+ * and VKFW_POINTER_GRABBED has no effect on its own.
+ *
+ * thread: any
  */
 VKFWAPI void
 vkfwSetPointerMode (VKFWwindow *handle, unsigned int mode);
 
+/**
+ * Ask for a VKFW_EVENT_FRAME_READY event when the window system wants the
+ * next frame for a window. The request takes effect with the next frame that
+ * is presented to the window, and the event is sent once that frame has been
+ * shown and it is a good time to start drawing another one. While the window
+ * is hidden, minimized or otherwise not visible, the event may not come at
+ * all, so an application that waits for it doesn't draw frames that nobody
+ * sees.
+ *
+ * Only one request can be pending per window; requesting another one before
+ * the event arrives does nothing.
+ *
+ * Returns VK_ERROR_FEATURE_NOT_PRESENT if the window system has no such
+ * mechanism; currently it is supported on Wayland, and on X11 with the
+ * xcb_frame_timings option (see vkfwBeginFrame).
+ *
+ * thread: any
+ */
+VKFWAPI VkResult
+vkfwRequestFrameCallback (VKFWwindow *handle);
+
+/**
+ * Presentation feedback flags:
+ *   VKFW_PRESENT_VSYNC          the frame was shown in sync with the vertical
+ *                               retrace, so it didn't tear
+ *   VKFW_PRESENT_HW_CLOCK       the time comes from the display hardware
+ *                               rather than from a software clock
+ *   VKFW_PRESENT_HW_COMPLETION  the display hardware signalled that the
+ *                               frame was shown, so it wasn't estimated
+ *   VKFW_PRESENT_ZERO_COPY      the frame was shown directly from the
+ *                               application's buffer, without composition
+ */
+#define VKFW_PRESENT_VSYNC 1U
+#define VKFW_PRESENT_HW_CLOCK 2U
+#define VKFW_PRESENT_HW_COMPLETION 4U
+#define VKFW_PRESENT_ZERO_COPY 8U
+
+/**
+ * Presentation feedback for one frame.
+ */
+typedef struct VKFWpresentfeedback_T {
+	/**
+	 * Whether the frame was shown. If it wasn't, because it was replaced
+	 * by a later frame or the window was hidden, the other fields are 0.
+	 */
+	bool presented;
+
+	/**
+	 * VKFW_PRESENT_* bits.
+	 */
+	uint32_t flags;
+
+	/**
+	 * When the frame was first shown, in the timebase of vkfwGetTime.
+	 */
+	uint64_t time;
+
+	/**
+	 * Predicted time from 'time' until the next refresh of the display, in
+	 * microseconds, or 0 if the display doesn't have a constant refresh
+	 * rate.
+	 */
+	uint64_t refresh;
+
+	/**
+	 * The display's refresh counter when the frame was first shown, or 0
+	 * if the display has none.
+	 */
+	uint64_t sequence;
+} VKFWpresentfeedback;
+
+#define VKFW_PRESENT_FEEDBACK_SIZE 16
+
+/**
+ * Ask for presentation feedback for the next frame that is presented to a
+ * window. Like vkfwRequestFrameCallback, the request takes effect with the
+ * next frame that is presented. Once the window system knows whether that
+ * frame made it to the screen, VKFW_EVENT_FRAME_PRESENTED or
+ * VKFW_EVENT_FRAME_DISCARDED is sent, and the feedback can be taken with
+ * vkfwGetPresentationFeedback.
+ *
+ * Applications that want feedback for every frame should call this before
+ * every present. Returns VK_NOT_READY if too many requests are pending, and
+ * VK_ERROR_FEATURE_NOT_PRESENT if the window system doesn't provide
+ * presentation feedback; currently it is only supported on Wayland.
+ *
+ * thread: any
+ */
+VKFWAPI VkResult
+vkfwRequestPresentationFeedback (VKFWwindow *handle);
+
+/**
+ * Take the oldest presentation feedback for a window, in the order of the
+ * FRAME_PRESENTED and FRAME_DISCARDED events. Returns false if there is
+ * none. The feedback is kept even if the events are masked; if the
+ * application doesn't take it, only the oldest VKFW_PRESENT_FEEDBACK_SIZE
+ * entries are kept, and feedback for later frames is dropped until there is
+ * room again.
+ *
+ * thread: any, but only one thread at a time per window
+ */
+VKFWAPI bool
+vkfwGetPresentationFeedback (VKFWwindow *handle, VKFWpresentfeedback *feedback);
+
+/**
+ * Tell the window system that a frame of the size from the last
+ * VKFW_EVENT_WINDOW_RESIZE_NOTIFY has been presented. Call this after
+ * presenting the first frame at a new size.
+ *
+ * On X11 with the xcb_sync_request option, the window manager waits for this
+ * before it resizes the window again (_NET_WM_SYNC_REQUEST), so interactive
+ * resizing goes exactly as fast as the application can draw, and doesn't
+ * show stretched frames. An application that sets the option must call this
+ * after every RESIZE_NOTIFY, or resizing will stall until the window manager
+ * gives up waiting. Elsewhere, this does nothing.
+ *
+ * thread: any
+ */
+VKFWAPI void
+vkfwAckResize (VKFWwindow *handle);
+
+/**
+ * Compositor timings for a frame, see vkfwGetFrameTimings.
+ */
+typedef struct VKFWframetimings_T {
+	/**
+	 * The frame, as returned by vkfwEndFrame.
+	 */
+	uint64_t frame;
+
+	/**
+	 * When the compositor drew the frame, in the timebase of vkfwGetTime.
+	 */
+	uint64_t drawn;
+
+	/**
+	 * When the frame was or will be shown on the screen, in the timebase
+	 * of vkfwGetTime, or 0 if the compositor doesn't know.
+	 */
+	uint64_t presented;
+
+	/**
+	 * Refresh interval of the display, in microseconds, or 0 if the
+	 * compositor doesn't know.
+	 */
+	uint64_t refresh;
+} VKFWframetimings;
+
+/**
+ * Mark the start and the end of drawing a frame for a window. The compositor
+ * doesn't show a window while a frame is being drawn, and after the end of
+ * a frame, it reports when it drew and showed it; see vkfwGetFrameTimings.
+ * Call vkfwBeginFrame before recording the commands for a frame, and
+ * vkfwEndFrame after presenting it.
+ *
+ * vkfwEndFrame returns the identifier of the frame, or 0 if the window system
+ * doesn't support frame timings. Currently they are supported on X11 with
+ * the xcb_frame_timings option, with compositors that implement
+ * _NET_WM_FRAME_DRAWN and _NET_WM_FRAME_TIMINGS. With it,
+ * vkfwRequestFrameCallback sends VKFW_EVENT_FRAME_READY when the compositor
+ * has drawn the last frame.
+ *
+ * thread: any
+ */
+VKFWAPI void
+vkfwBeginFrame (VKFWwindow *handle);
+
+VKFWAPI uint64_t
+vkfwEndFrame (VKFWwindow *handle);
+
+/**
+ * Get the compositor timings of the most recent frame that the compositor
+ * has reported on. Returns false if there are none. Applications can use
+ * the presentation time and the refresh interval to predict when the next
+ * frame will be shown, and start drawing it just in time, rather than as
+ * early as possible.
+ *
+ * thread: any
+ */
+VKFWAPI bool
+vkfwGetFrameTimings (VKFWwindow *handle, VKFWframetimings *timings);
+
+/**
+ * Event mask bits. Bit n of an event mask corresponds to event type n.
+ */
+#define VKFW_EVENT_BIT(type) (1U << (type))
+#define VKFW_EVENT_MASK_ALL (~0U)
+#define VKFW_EVENT_MASK_KEYBOARD (VKFW_EVENT_BIT (VKFW_EVENT_KEY_PRESSED)	\
+	| VKFW_EVENT_BIT (VKFW_EVENT_KEY_RELEASED)				\
+	| VKFW_EVENT_BIT (VKFW_EVENT_TEXT_INPUT))
+#define VKFW_EVENT_MASK_POINTER (VKFW_EVENT_BIT (VKFW_EVENT_POINTER_MOTION)	\
+	| VKFW_EVENT_BIT (VKFW_EVENT_BUTTON_PRESSED)				\
+	| VKFW_EVENT_BIT (VKFW_EVENT_BUTTON_RELEASED)				\
+	| VKFW_EVENT_BIT (VKFW_EVENT_SCROLL)					\
+	| VKFW_EVENT_BIT (VKFW_EVENT_RELATIVE_POINTER_MOTION))
+
+/**
+ * Select which events are generated for a window. 'mask' is a bitmask of
+ * VKFW_EVENT_BIT (type). Events that are not in the mask are not delivered,
+ * and where the window system allows it, they are not even sent to us; for
+ * example on X11, a window without VKFW_EVENT_POINTER_MOTION in its mask
+ * doesn't receive MotionNotify events at all.
+ *
+ * The key and button state (see vkfwGetKeyState) is only tracked for events
+ * in the mask. The default mask is VKFW_EVENT_MASK_ALL.
+ *
+ * thread: any
+ */
+VKFWAPI void
+vkfwSetWindowEventMask (VKFWwindow *handle, unsigned int mask);
+
+/**
+ * Event coalescing bits. See vkfwSetEventCoalescing.
+ */
+#define VKFW_COALESCE_NONE 0U
+#define VKFW_COALESCE_POINTER_MOTION 1U
+#define VKFW_COALESCE_RELATIVE_POINTER_MOTION 2U
+#define VKFW_COALESCE_SCROLL 4U
+#define VKFW_COALESCE_RESIZE 8U
+#define VKFW_COALESCE_ALL 15U
+
+/**
+ * Set the event coalescing policy for a window. 'flags' is a bitmask of
+ * VKFW_COALESCE_*. Within one batch of events read from the window system,
+ * consecutive events of a coalesced type for the same window are merged:
+ *   VKFW_COALESCE_POINTER_MOTION           only the last position is delivered
+ *   VKFW_COALESCE_RELATIVE_POINTER_MOTION  deltas are summed
+ *   VKFW_COALESCE_SCROLL                   scroll_value is summed (per
+ *                                          direction)
+ *   VKFW_COALESCE_RESIZE                   only the last extent is delivered
+ *
+ * Any other event for any window ends the run, so event ordering is
+ * preserved. The default is VKFW_COALESCE_NONE.
+ *
+ * thread: main
+ */
+VKFWAPI void
+vkfwSetEventCoalescing (VKFWwindow *handle, unsigned int flags);
+
 	/* Input */
 
 /**
  * Convert a platform keycode into a VKFW key. Returns VKFW_KEY_UNKNOWN if the
  * translation could not be determined or if the keycode does not correspond to
  * a VKFW key.
+ *
+ * thread: any
  */
 VKFWAPI int
 vkfwTranslateKeycode (int keycode);
@@ -582,10 +939,57 @@ vkfwTranslateKeycode (int keycode);
  * Convert a VKFW key into a platform keycode. Returns VKFW_KEY_UNKNOWN if the
  * translation could not be determined or if the key does not have a keycode in
  * the current keyboard layout.
+ *
+ * thread: any
  */
 VKFWAPI int
 vkfwTranslateKey (int key);
 
+/**
+ * Query whether a key, keycode or mouse button is currently held down in a
+ * window. The state follows the KEY_PRESSED/KEY_RELEASED and
+ * BUTTON_PRESSED/BUTTON_RELEASED events for the window as they are read
+ * from the window system, and everything is released when the window loses
+ * focus.
+ *
+ * The state can be ahead of the events that have been delivered to the
+ * application by a batch of events, or by more with the input_thread
+ * option.
+ *
+ * thread: any
+ */
+VKFWAPI bool
+vkfwGetKeyState (VKFWwindow *window, int key);
+
+VKFWAPI bool
+vkfwGetKeycodeState (VKFWwindow *window, int keycode);
+
+VKFWAPI bool
+vkfwGetButtonState (VKFWwindow *window, int button);
+
+/**
+ * A copy of the pressed keys, keycodes and buttons of a window. Bit n of
+ * keys[n / 64] is set if key n is pressed, and so on. Bit n of buttons is
+ * set if button n is pressed.
+ */
+typedef struct VKFWkeyboardsnapshot_T {
+	uint64_t keys[VKFW_MAX_KEYS / 64];
+	uint64_t keycodes[VKFW_MAX_KEYCODES / 64];
+	uint32_t buttons;
+} VKFWkeyboardsnapshot;
+
+/**
+ * Copy the complete input state of a window at once. This is meant for
+ * applications that sample input once per simulation tick.
+ *
+ * note: the snapshot is not atomic as a whole, but every 64-bit word in it
+ * is.
+ *
+ * thread: any
+ */
+VKFWAPI void
+vkfwGetKeyboardSnapshot (VKFWwindow *window, VKFWkeyboardsnapshot *snapshot);
+
 /**
  * Note on text input:
  *   A game may have a keybind for opening the chat, for example 'T'. Now, when
@@ -610,21 +1014,51 @@ vkfwTranslateKey (int key);
 
 /**
  * Enable the generation of VKFW_EVENT_TEXT_INPUT events.
+ *
+ * thread: any
  */
 VKFWAPI void
 vkfwEnableTextInput (VKFWwindow *window);
 
 /**
  * Disable the generation of VKFW_EVENT_TEXT_INPUT events.
+ *
+ * thread: any
  */
 VKFWAPI void
 vkfwDisableTextInput (VKFWwindow *window);
 
+/**
+ * Collect text input in a buffer instead of generating a VKFW_EVENT_TEXT_INPUT
+ * event for every codepoint. The application retrieves the text with
+ * vkfwGetTextInput, typically once per frame. Text input must still be
+ * enabled with vkfwEnableTextInput.
+ *
+ * The buffer holds about a kilobyte of text; text that doesn't fit is
+ * dropped.
+ *
+ * thread: any
+ */
+VKFWAPI void
+vkfwSetTextInputBuffering (VKFWwindow *window, bool enable);
+
+/**
+ * Copy buffered text input into buffer as a NUL-terminated UTF-8 string, and
+ * remove it from the window's buffer. Returns the length of the string. If
+ * the text doesn't fit in size bytes, the rest is left for the next call.
+ *
+ * thread: any, but only one thread at a time per window
+ */
+VKFWAPI size_t
+vkfwGetTextInput (VKFWwindow *window, char *buffer, size_t size);
+
 	/* Events */
 
 /**
  * This function is required to be called when an application doesn't handle an
  * event.
+ *
+ * thread: any
  */
 VKFWAPI void
 vkfwUnhandledEvent (VKFWevent *e);
@@ -638,29 +1072,165 @@ typedef void (*VKFWeventhandler) (VKFWevent *, void *);
  * vkfwDispatchEvents, but because of platform specifics, it can also be called
  * any time the user calls an external function that interacts with the window
  * system (including other VKFW functions and Vulkan WSI functions).
+ *
+ * thread: main
  */
 VKFWAPI VKFWeventhandler
 vkfwSetEventHandler (VKFWeventhandler handler, void *user);
 
+/**
+ * Set an event handler for the events of one window. If it is set, it is
+ * called instead of the handler set with vkfwSetEventHandler. This returns
+ * the old handler of the window.
+ *
+ * thread: main
+ */
+VKFWAPI VKFWeventhandler
+vkfwSetWindowEventHandler (VKFWwindow *handle, VKFWeventhandler handler, void *user);
+
+/**
+ * Route the events of a window to a queue of its own instead of the event
+ * handler. Events are still read from the window system by the thread that
+ * calls vkfwDispatchEvents or vkfwGetEvents, but they are only delivered when
+ * some other thread, typically the thread that renders to the window, calls
+ * vkfwDispatchWindowEvents.
+ *
+ * When routing is disabled again, events that are still in the queue of the
+ * window can be drained with vkfwDispatchWindowEvents.
+ *
+ * thread: main
+ */
+VKFWAPI VkResult
+vkfwSetWindowEventRouting (VKFWwindow *handle, bool enable);
+
+/**
+ * Call handler for every event in the queue of a window, in order. This can
+ * be called from any thread, but only from one thread at a time for a given
+ * window, and doesn't take any locks. Returns the number of events that were
+ * dispatched.
+ *
+ * thread: any, but only one thread at a time per window
+ */
+VKFWAPI uint32_t
+vkfwDispatchWindowEvents (VKFWwindow *handle, VKFWeventhandler handler, void *user);
+
 /**
  * Dispatch events.
  *
  * mode is one of VKFW_EVENT_MODE_POLL, VKFW_EVENT_MODE_TIMEOUT, and
  * VKFW_EVENT_MODE_DEADLINE. timeout is an optional timeout.
+ *
+ * thread: main
  */
 VKFWAPI VkResult
 vkfwDispatchEvents (int mode, uint64_t timeout);
 
+/**
+ * Retrieve events without going through the event handler.
+ *
+ * On input, *count is the number of elements in events. On return, *count is
+ * the number of events that were written. If there are no pending events,
+ * this function waits for events according to mode and timeout, just like
+ * vkfwDispatchEvents, but returns as soon as at least one event is available.
+ *
+ * The windows of the returned events are kept alive until the next call to
+ * vkfwGetEvents or vkfwDispatchEvents, so that the window pointers can still
+ * be looked at if another thread destroys a window in the meantime.
+ *
+ * Returns VK_INCOMPLETE if more events are pending than fit in events. The
+ * count is passed in and out like in vkEnumerate* functions, so that errors
+ * from the window system can be returned as a VkResult just like from
+ * vkfwDispatchEvents.
+ *
+ * Events are only collected while vkfwGetEvents is running. Pending events
+ * that are not picked up by the next call to vkfwGetEvents are delivered by
+ * the next call to vkfwDispatchEvents, the same way as any other event: to
+ * the window queue, the window event handler, or the event handler.
+ * Events that arrive while no event handler is set are dropped.
+ *
+ * thread: main
+ */
+VKFWAPI VkResult
+vkfwGetEvents (uint32_t *count, VKFWevent *events, int mode, uint64_t timeout);
+
+/**
+ * Wake up the thread that is blocked in vkfwDispatchEvents or vkfwGetEvents.
+ * The blocked call returns as soon as it has handled the events that are
+ * already available. If no thread is blocked, the next call to either
+ * function returns without waiting.
+ *
+ * thread: any
+ */
+VKFWAPI void
+vkfwPostEmptyEvent (void);
+
+/**
+ * Bits for vkfwAddEventFd and VKFWfdhandler.
+ */
+#define VKFW_FD_READABLE 1U
+#define VKFW_FD_WRITABLE 2U
+#define VKFW_FD_ERROR 4U
+
+typedef void (*VKFWfdhandler) (int fd, unsigned int events, void *user);
+
+/**
+ * Add a file descriptor (a socket, an inotify or eventfd instance, ...) to the
+ * set of file descriptors that VKFW waits on in vkfwDispatchEvents and
+ * vkfwGetEvents. 'events' is a bitmask of VKFW_FD_READABLE and
+ * VKFW_FD_WRITABLE. When the file descriptor becomes ready, handler is called
+ * from within vkfwDispatchEvents or vkfwGetEvents with a bitmask of VKFW_FD_*.
+ *
+ * Returns VK_ERROR_FEATURE_NOT_PRESENT on platforms without file descriptors.
+ *
+ * thread: main
+ */
+VKFWAPI VkResult
+vkfwAddEventFd (int fd, unsigned int events, VKFWfdhandler handler, void *user);
+
+/**
+ * Remove a file descriptor that was added with vkfwAddEventFd.
+ *
+ * thread: main
+ */
+VKFWAPI void
+vkfwRemoveEventFd (int fd);
+
+/**
+ * Get a file descriptor which becomes readable whenever vkfwDispatchEvents has
+ * work to do. This allows VKFW to be nested inside another event loop (epoll,
+ * io_uring, ...): wait for the fd to become readable, then call
+ * vkfwDispatchEvents with VKFW_EVENT_MODE_POLL.
+ *
+ * Returns -1 on platforms without file descriptors.
+ *
+ * thread: any
+ */
+VKFWAPI int
+vkfwGetEventFd (void);
+
 /**
  * Query a platform timer. Return value is in microseconds. The platform timer
  * is expected to be monotonic.
+ *
+ * thread: any
  */
 VKFWAPI uint64_t
 vkfwGetTime (void);
 
+/**
+ * Sleep for at least t microseconds.
+ *
+ * thread: any
+ */
 VKFWAPI void
 vkfwDelay (uint64_t t);
 
+/**
+ * Sleep until vkfwGetTime returns t or more. This returns immediately if t is
+ * in the past.
+ *
+ * thread: any
+ */
 VKFWAPI void
 vkfwDelayUntil (uint64_t t);
 
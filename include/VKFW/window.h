@@ -9,18 +9,96 @@
 #ifndef VKFW_WINDOW_H
 #define VKFW_WINDOW_H 1
 
+#include <VKFW/ring.h>
 #include <VKFW/vkfw.h>
+#include <atomic>
+
+/**
+ * This must be a power of two.
+ */
+#define VKFW_TEXT_BUFFER_SIZE 1024
+#define VKFW_WINDOW_QUEUE_SIZE 256
+
+/**
+ * Events that are routed to a window, see vkfwSetWindowEventRouting. They
+ * are pushed by the thread that dispatches events and popped by the thread
+ * that calls vkfwDispatchWindowEvents. Unlike events in the global queues,
+ * they don't hold references to the window.
+ */
+typedef VKFWring<VKFWevent, VKFW_WINDOW_QUEUE_SIZE> VKFWwindowqueue;
 
 struct VKFWwindow_T {
-	void *user;
-	VkExtent2D extent;
-	unsigned int internal_refcnt;
-	unsigned int flags;
-	unsigned int pointer_flags;
+	std::atomic<void *> user;
+
+	/**
+	 * The extent as of the last WINDOW_RESIZE_NOTIFY that was translated.
+	 */
+	std::atomic<VkExtent2D> extent;
+
+	/**
+	 * Events hold references to their window. They may be taken on the
+	 * input thread and dropped on the application thread.
+	 */
+	std::atomic<unsigned int> internal_refcnt;
+
+	/**
+	 * VKFW_WINDOW_* bits.
+	 */
+	std::atomic<unsigned int> flags;
+
+	/**
+	 * Set by the window functions on any thread, and read by the backend
+	 * while it translates events. coalesce_flags is only used on the main
+	 * thread.
+	 */
+	std::atomic<unsigned int> pointer_flags;
+	std::atomic<unsigned int> event_mask;
+	unsigned int coalesce_flags;
+	std::atomic<int> visibility;
+
+	VKFWeventhandler event_handler;
+	void *event_user;
+
+	/**
+	 * queue is allocated by the main thread when routing is first
+	 * enabled, and freed with the window. It is read by whichever thread
+	 * dispatches the events of the window, so it is published with
+	 * release and read with acquire.
+	 */
+	std::atomic<bool> routed;
+	bool queue_overflowed;
+	std::atomic<VKFWwindowqueue *> queue;
+
+	/**
+	 * Pressed keys, keycodes and buttons. These are only written by the
+	 * thread that translates events, but may be read from any thread.
+	 */
+	std::atomic<uint64_t> key_state[VKFW_MAX_KEYS / 64];
+	std::atomic<uint64_t> keycode_state[VKFW_MAX_KEYCODES / 64];
+	std::atomic<uint32_t> button_state;
+
+	/**
+	 * UTF-8 text that is waiting for vkfwGetTextInput. Like in VKFWring,
+	 * text_head and text_tail are free-running counters; the thread that
+	 * translates events appends at text_tail, and vkfwGetTextInput takes
+	 * from text_head. text_overflowed is set when text was dropped, until
+	 * there is room again, and is only used by the translating thread.
+	 */
+	std::atomic<uint32_t> text_head, text_tail;
+	bool text_overflowed;
+	char text[VKFW_TEXT_BUFFER_SIZE];
+
+	/**
+	 * Presentation feedback that is waiting for
+	 * vkfwGetPresentationFeedback, in the same kind of ring as text.
+	 */
+	std::atomic<uint32_t> feedback_head, feedback_tail;
+	VKFWpresentfeedback feedback[VKFW_PRESENT_FEEDBACK_SIZE];
 };
 
 #define VKFW_WINDOW_DELETED 1U
 #define VKFW_WINDOW_TEXT_INPUT_ENABLED 2U
+#define VKFW_WINDOW_TEXT_INPUT_BUFFERED 4U
 
 void
 vkfwRefWindow (VKFWwindow *window);
@@ -28,4 +106,19 @@ vkfwRefWindow (VKFWwindow *window);
 void
 vkfwUnrefWindow (VKFWwindow *window);
 
+/**
+ * Set the VKFW_VISIBILITY_* of a window. Returns the VKFW_EVENT_WINDOW_*
+ * visibility event to send, or VKFW_EVENT_NULL if nothing changed.
+ */
+int
+vkfwUpdateWindowVisibility (VKFWwindow *window, int visibility);
+
+/**
+ * Store presentation feedback for a window and send the FRAME_PRESENTED or
+ * FRAME_DISCARDED event for it. Called with vkfw_input_mu held, like
+ * vkfwSendEventToApplication.
+ */
+void
+vkfwSendPresentationFeedback (VKFWwindow *window, const VKFWpresentfeedback *feedback);
+
 #endif /* VKFW_WINDOW_H */
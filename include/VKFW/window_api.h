@@ -27,7 +27,12 @@ struct VKFWwindowbackend_T {
 
 	/**
 	 * Create a platform-specific VKFWwindow. Generic fields are already
-	 * filled-in.
+	 * filled-in. create_window and destroy_window are called with
+	 * vkfw_input_mu held.
+	 *
+	 * The other window functions may be called from any thread, without
+	 * vkfw_input_mu held. If they change state that is also used while
+	 * translating events, they must lock it themselves.
 	 */
 	VkResult (*create_window) (VKFWwindow *);
 	void (*destroy_window) (VKFWwindow *);
@@ -44,26 +49,97 @@ struct VKFWwindowbackend_T {
 	/**
 	 * Generic handler for retrieving events. The second argument is one of
 	 * VKFW_EVENT_MODE_POLL, VKFW_EVENT_MODE_TIMEOUT and
-	 * VKFW_EVENT_MODE_DEADLINE.
+	 * VKFW_EVENT_MODE_DEADLINE. The core only calls this in
+	 * VKFW_EVENT_MODE_POLL, with vkfw_input_mu held, and waits for the
+	 * window system itself.
 	 */
 	VkResult (*get_event) (VKFWevent *, int, uint64_t);
 
 	int (*translate_keycode) (int);
 	int (*translate_key) (int);
 
+	/**
+	 * Optional. Called when text input is enabled for a window, so that
+	 * the backend can prepare whatever it needs to generate text input.
+	 */
+	void (*enable_text_input) (VKFWwindow *);
+
 	void (*update_pointer_mode) (VKFWwindow *);
 
+	/**
+	 * Optional. Called by vkfwRequestFrameCallback.
+	 */
+	VkResult (*request_frame) (VKFWwindow *);
+
+	/**
+	 * Optional. Called when the event mask of a window changes, so that
+	 * the backend can stop asking the window system for events that the
+	 * application doesn't want. The core filters events by the mask
+	 * regardless.
+	 */
+	void (*update_event_mask) (VKFWwindow *);
+
+	/**
+	 * Optional. Called by vkfwRequestPresentationFeedback. The backend
+	 * reports the outcome with vkfwSendPresentationFeedback.
+	 */
+	VkResult (*request_presentation_feedback) (VKFWwindow *);
+
+	/**
+	 * Optional. Called by vkfwAckResize.
+	 */
+	void (*ack_resize) (VKFWwindow *);
+
+	/**
+	 * Optional. Called by vkfwBeginFrame, vkfwEndFrame and
+	 * vkfwGetFrameTimings.
+	 */
+	void (*begin_frame) (VKFWwindow *);
+	uint64_t (*end_frame) (VKFWwindow *);
+	bool (*get_frame_timings) (VKFWwindow *, VKFWframetimings *);
+
 	/**
 	 * Generic handler for dispatching events. This will be used if
 	 * supported by the backend. Otherwise fall back to get_event.
 	 *
-	 * Call vkfwSendEventToApplication with any events.
+	 * Call vkfwSendEventToApplication with any events. The backend takes
+	 * vkfw_input_mu while it translates events, and releases it before
+	 * calling vkfwFlushEvents and before blocking.
 	 *
 	 * The second argument is one of VKFW_EVENT_MODE_POLL,
 	 * VKFW_EVENT_MODE_TIMEOUT and VKFW_EVENT_MODE_DEADLINE. The third
 	 * argument is optionally a timeout.
 	 */
 	VkResult (*dispatch_events) (int, uint64_t);
+
+	/**
+	 * Optional support for the input_thread option.
+	 *
+	 * init_input_thread is called on the application thread before the
+	 * input thread is started. From then on, the input thread is the only
+	 * one to call dispatch_events (or get_event, if dispatch_events is not
+	 * implemented), always in VKFW_EVENT_MODE_POLL.
+	 *
+	 * wait_input is called on the input thread without vkfw_input_mu held.
+	 * It blocks until get_event has something to return, or until
+	 * wake_input_thread is called from another thread.
+	 *
+	 * cancel_input_thread is called on the application thread if the
+	 * input thread could not be started after init_input_thread succeeded.
+	 * It undoes init_input_thread, so that the application thread reads
+	 * events itself again.
+	 */
+	VkResult (*init_input_thread) (void);
+	VkResult (*wait_input) (void);
+	void (*wake_input_thread) (void);
+	void (*cancel_input_thread) (void);
+
+	/**
+	 * Send buffered requests to the window system. Backends flush once
+	 * per batch of events in dispatch_events; while the input thread is
+	 * running, the core calls this once per vkfwDispatchEvents instead.
+	 */
+	void (*flush) (void);
 };
 
 extern VKFWwindowbackend *vkfwCurrentWindowBackend;
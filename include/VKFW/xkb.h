@@ -0,0 +1,139 @@
+/**
+ * xkbcommon keyboard handling shared by the X11 and Wayland backends.
+ * Copyright (C) 2024  dbstream
+ *
+ * This is an internal header.
+ */
+#include <VKFW/warn_internal.h>
+
+#ifndef VKFW_XKB_H
+#define VKFW_XKB_H 1
+
+#include <VKFW/vkfw.h>
+#include <xkbcommon/xkbcommon.h>
+#include <xkbcommon/xkbcommon-compose.h>
+
+#define VKFW_XKB_ALL_FUNCS(macro)		\
+macro(xkb_context_new)				\
+macro(xkb_context_unref)			\
+macro(xkb_context_set_log_level)		\
+macro(xkb_keymap_new_from_buffer)		\
+macro(xkb_keymap_unref)				\
+macro(xkb_keymap_key_get_name)			\
+macro(xkb_keymap_key_repeats)			\
+macro(xkb_keymap_mod_get_index)			\
+macro(xkb_state_new)				\
+macro(xkb_state_unref)				\
+macro(xkb_state_key_get_one_sym)		\
+macro(xkb_state_update_mask)			\
+macro(xkb_state_mod_index_is_active)		\
+macro(xkb_keysym_to_utf32)			\
+macro(xkb_compose_table_new_from_locale)	\
+macro(xkb_compose_table_unref)			\
+macro(xkb_compose_state_new)			\
+macro(xkb_compose_state_unref)			\
+macro(xkb_compose_state_feed)			\
+macro(xkb_compose_state_reset)			\
+macro(xkb_compose_state_get_status)		\
+macro(xkb_compose_state_get_one_sym)		\
+macro(xkb_compose_state_get_utf8)
+
+#define VKFW_XKB_DEFINE_FUNC(name)	\
+typedef decltype(&name) PFN##name;	\
+extern PFN##name vkfw_##name;
+VKFW_XKB_ALL_FUNCS(VKFW_XKB_DEFINE_FUNC)
+#undef VKFW_XKB_DEFINE_FUNC
+
+#define xkb_context_new vkfw_xkb_context_new
+#define xkb_context_unref vkfw_xkb_context_unref
+#define xkb_context_set_log_level vkfw_xkb_context_set_log_level
+#define xkb_keymap_new_from_buffer vkfw_xkb_keymap_new_from_buffer
+#define xkb_keymap_unref vkfw_xkb_keymap_unref
+#define xkb_keymap_key_get_name vkfw_xkb_keymap_key_get_name
+#define xkb_keymap_key_repeats vkfw_xkb_keymap_key_repeats
+#define xkb_keymap_mod_get_index vkfw_xkb_keymap_mod_get_index
+#define xkb_state_new vkfw_xkb_state_new
+#define xkb_state_unref vkfw_xkb_state_unref
+#define xkb_state_key_get_one_sym vkfw_xkb_state_key_get_one_sym
+#define xkb_state_update_mask vkfw_xkb_state_update_mask
+#define xkb_state_mod_index_is_active vkfw_xkb_state_mod_index_is_active
+#define xkb_keysym_to_utf32 vkfw_xkb_keysym_to_utf32
+#define xkb_compose_table_new_from_locale vkfw_xkb_compose_table_new_from_locale
+#define xkb_compose_table_unref vkfw_xkb_compose_table_unref
+#define xkb_compose_state_new vkfw_xkb_compose_state_new
+#define xkb_compose_state_unref vkfw_xkb_compose_state_unref
+#define xkb_compose_state_feed vkfw_xkb_compose_state_feed
+#define xkb_compose_state_reset vkfw_xkb_compose_state_reset
+#define xkb_compose_state_get_status vkfw_xkb_compose_state_get_status
+#define xkb_compose_state_get_one_sym vkfw_xkb_compose_state_get_one_sym
+#define xkb_compose_state_get_utf8 vkfw_xkb_compose_state_get_utf8
+
+/**
+ * The VKFW_MODIFIER_* bits, in the order of VKFWxkbkeyboard::mods.
+ */
+#define VKFW_XKB_NUM_MODS 6
+
+/**
+ * Keyboard state. Platform keycodes are XKB keycodes on all backends; on
+ * Wayland, that is the evdev code plus 8.
+ */
+struct VKFWxkbkeyboard {
+	xkb_keymap *keymap;
+	xkb_state *state;
+	xkb_compose_state *compose;
+	xkb_mod_index_t mods[VKFW_XKB_NUM_MODS];
+};
+
+extern xkb_context *vkfw_xkb_ctx;
+
+/**
+ * Load libxkbcommon and create the context. On failure, keyboard input will
+ * not be translated. The compose table is loaded later, by
+ * vkfwXkbEnableTextInput.
+ */
+bool
+vkfwXkbInit (const char *backend_name);
+
+void
+vkfwXkbTerminate (void);
+
+/**
+ * Backend enable_text_input hook. The first call starts loading the compose
+ * table on a background thread.
+ */
+void
+vkfwXkbEnableTextInput (VKFWwindow *window);
+
+/**
+ * Replace the keymap and state of kbd, and update the keycode lookup tables
+ * for keycodes first...last (inclusive). Other keycodes are assumed to be
+ * unchanged. This takes ownership of keymap and state, even on failure.
+ */
+bool
+vkfwXkbSetKeymap (VKFWxkbkeyboard *kbd, xkb_keymap *keymap, xkb_state *state,
+	int first, int last);
+
+void
+vkfwXkbReleaseKeyboard (VKFWxkbkeyboard *kbd);
+
+int
+vkfwXkbTranslateKeycode (int keycode);
+
+int
+vkfwXkbTranslateKey (int key);
+
+/**
+ * Feed a key press to the compose machinery, and queue a TEXT_INPUT event
+ * for whatever it produces. e is the KEY_PRESSED event. This does nothing
+ * if text input is disabled for the window.
+ */
+void
+vkfwXkbKeyPress (VKFWxkbkeyboard *kbd, const VKFWevent *e);
+
+/**
+ * Get the active VKFW_MODIFIER_* bits.
+ */
+unsigned int
+vkfwXkbGetModifiers (VKFWxkbkeyboard *kbd);
+
+#endif /* VKFW_XKB_H */
@@ -4,10 +4,16 @@
  */
 #include <VKFW/logging.h>
 #include <VKFW/platform.h>
+#include <VKFW/vector.h>
 #include <VKFW/window_api.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <dlfcn.h>
 #include <errno.h>
 #include <time.h>
+#include <unistd.h>
+#include <mutex>
 
 static void *libvulkan_handle;
 
@@ -57,9 +63,263 @@ loadVulkanUnix (void **vulkan_loader)
 	return VK_SUCCESS;
 }
 
+/**
+ *   The wait set.
+ *
+ * All blocking in the event loop goes through a single epoll instance. It
+ * contains the connection fd of the window backend, any fds that the
+ * application has registered with vkfwAddEventFd, and a CLOCK_MONOTONIC
+ * timerfd that is armed with the absolute deadline for the duration of a
+ * wait. Using the timerfd instead of the epoll_wait timeout means that
+ * deadlines are not rounded to milliseconds and are not affected by the time
+ * spent before we go to sleep.
+ *
+ * The epoll fd itself is handed out by vkfwGetEventFd, so applications can
+ * nest VKFW inside their own event loop.
+ *
+ * An eventfd is also part of the wait set; vkfwPostEmptyEvent writes to it
+ * from other threads to interrupt epoll_wait.
+ */
+
+struct wait_entry {
+	int fd;
+	unsigned int ready_events;
+	VKFWfdhandler handler;
+	void *user;
+};
+
+static int epoll_fd = -1;
+static int timer_fd = -1;
+static int wakeup_fd = -1;
+
+static VKFWvector<wait_entry> wait_entries;
+static std::mutex wait_mu;
+
+static uint32_t
+to_epoll_events (unsigned int events)
+{
+	uint32_t ev = 0;
+	if (events & VKFW_FD_READABLE)
+		ev |= EPOLLIN;
+	if (events & VKFW_FD_WRITABLE)
+		ev |= EPOLLOUT;
+	return ev;
+}
+
+static unsigned int
+from_epoll_events (uint32_t ev)
+{
+	unsigned int events = 0;
+	if (ev & EPOLLIN)
+		events |= VKFW_FD_READABLE;
+	if (ev & EPOLLOUT)
+		events |= VKFW_FD_WRITABLE;
+	if (ev & (EPOLLERR | EPOLLHUP))
+		events |= VKFW_FD_ERROR;
+	return events;
+}
+
+static VkResult
+addWaitFdUnix (int fd, unsigned int events, VKFWfdhandler handler, void *user)
+{
+	std::scoped_lock g (wait_mu);
+
+	wait_entry entry {};
+	entry.fd = fd;
+	entry.handler = handler;
+	entry.user = user;
+	if (!wait_entries.push_back (entry))
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+
+	struct epoll_event ev {};
+	ev.events = to_epoll_events (events);
+	ev.data.fd = fd;
+	if (epoll_ctl (epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		vkfwPrintf (VKFW_LOG_PLATFORM, "VKFW: epoll_ctl(ADD, %d) failed with errno %d\n", fd, errno);
+		wait_entries.pop_back ();
+		return VK_ERROR_UNKNOWN;
+	}
+
+	return VK_SUCCESS;
+}
+
+static void
+removeWaitFdUnix (int fd)
+{
+	std::scoped_lock g (wait_mu);
+
+	size_t n = wait_entries.size ();
+	for (size_t i = 0; i < n; i++) {
+		if (wait_entries[i].fd == fd) {
+			epoll_ctl (epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+			if (i < n - 1)
+				wait_entries[i] = wait_entries[n - 1];
+			wait_entries.pop_back ();
+			return;
+		}
+	}
+}
+
+static void
+set_timer (uint64_t deadline)
+{
+	struct itimerspec its {};
+	its.it_value.tv_sec = deadline / 1000000;
+	its.it_value.tv_nsec = (deadline % 1000000) * 1000;
+	timerfd_settime (timer_fd, TFD_TIMER_ABSTIME, &its, nullptr);
+}
+
+static void
+clear_timer (void)
+{
+	struct itimerspec its {};
+	timerfd_settime (timer_fd, 0, &its, nullptr);
+
+	uint64_t expirations;
+	while (read (timer_fd, &expirations, sizeof (expirations)) == -1 && errno == EINTR);
+}
+
+static void
+waitUntilUnix (uint64_t deadline)
+{
+	int timeout = -1;
+	if (!deadline)
+		timeout = 0;
+	else if (deadline != UINT64_MAX)
+		set_timer (deadline);
+
+	struct epoll_event events[16];
+	int n = epoll_wait (epoll_fd, events, 16, timeout);
+
+	if (deadline && deadline != UINT64_MAX)
+		clear_timer ();
+
+	if (n <= 0)
+		return;
+
+	/**
+	 * Handlers are not called from here, as the backend may be in a state
+	 * where it cannot be reentered (for example, holding a Wayland read
+	 * intent). Record which fds are ready and let dispatchWaitFds call the
+	 * handlers once the backend is done.
+	 */
+	std::scoped_lock g (wait_mu);
+	for (int i = 0; i < n; i++) {
+		if (events[i].data.fd == timer_fd)
+			continue;
+
+		if (events[i].data.fd == wakeup_fd) {
+			uint64_t value;
+			while (read (wakeup_fd, &value, sizeof (value)) == -1 && errno == EINTR);
+			continue;
+		}
+
+		for (wait_entry &entry : wait_entries) {
+			if (entry.fd == events[i].data.fd) {
+				if (entry.handler)
+					entry.ready_events |= from_epoll_events (events[i].events);
+				break;
+			}
+		}
+	}
+}
+
+static void
+dispatchWaitFdsUnix (void)
+{
+	/**
+	 * Iterate backwards, so that handlers can add or remove fds (including
+	 * their own) without us skipping or repeating entries.
+	 */
+	std::unique_lock g (wait_mu);
+	for (size_t i = wait_entries.size (); i-- > 0;) {
+		if (i >= wait_entries.size ())
+			continue;
+
+		wait_entry entry = wait_entries[i];
+		if (!entry.ready_events)
+			continue;
+
+		wait_entries[i].ready_events = 0;
+		g.unlock ();
+		entry.handler (entry.fd, entry.ready_events, entry.user);
+		g.lock ();
+	}
+}
+
+static int
+getWaitFdUnix (void)
+{
+	return epoll_fd;
+}
+
+static void
+postEmptyEventUnix (void)
+{
+	uint64_t value = 1;
+	while (write (wakeup_fd, &value, sizeof (value)) == -1 && errno == EINTR);
+}
+
+static int
+add_internal_fd (int fd)
+{
+	struct epoll_event ev {};
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	return epoll_ctl (epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static VkResult
+initPlatformUnix (void)
+{
+	epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+	if (epoll_fd == -1) {
+		vkfwPrintf (VKFW_LOG_PLATFORM, "VKFW: initPlatformUnix failed: epoll_create1 failed with errno %d\n", errno);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	timer_fd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (timer_fd == -1) {
+		vkfwPrintf (VKFW_LOG_PLATFORM, "VKFW: initPlatformUnix failed: timerfd_create failed with errno %d\n", errno);
+		goto err_epoll;
+	}
+
+	wakeup_fd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (wakeup_fd == -1) {
+		vkfwPrintf (VKFW_LOG_PLATFORM, "VKFW: initPlatformUnix failed: eventfd failed with errno %d\n", errno);
+		goto err_timer;
+	}
+
+	if (add_internal_fd (timer_fd) == -1 || add_internal_fd (wakeup_fd) == -1) {
+		vkfwPrintf (VKFW_LOG_PLATFORM, "VKFW: initPlatformUnix failed: failed to add internal fds to the wait set\n");
+		goto err_wakeup;
+	}
+
+	return VK_SUCCESS;
+
+err_wakeup:
+	close (wakeup_fd);
+	wakeup_fd = -1;
+err_timer:
+	close (timer_fd);
+	timer_fd = -1;
+err_epoll:
+	close (epoll_fd);
+	epoll_fd = -1;
+	return VK_ERROR_INITIALIZATION_FAILED;
+}
+
 static void
 terminatePlatformUnix (void)
 {
+	wait_entries.resize (0);
+	close (wakeup_fd);
+	close (timer_fd);
+	close (epoll_fd);
+	wakeup_fd = -1;
+	timer_fd = -1;
+	epoll_fd = -1;
+
 	if (libvulkan_handle) {
 		unloadModuleUnix (libvulkan_handle);
 		libvulkan_handle = nullptr;
@@ -124,6 +384,7 @@ delayUntilUnix (uint64_t target)
 }
 
 VKFWplatform vkfwPlatformUnix = {
+	.initPlatform = initPlatformUnix,
 	.terminatePlatform = terminatePlatformUnix,
 	.loadVulkan = loadVulkanUnix,
 	.initBackend = initBackendUnix,
@@ -131,5 +392,11 @@ VKFWplatform vkfwPlatformUnix = {
 	.unloadModule = unloadModuleUnix,
 	.lookupSymbol = lookupSymbolUnix,
 	.getTime = getTimeUnix,
-	.delayUntil = delayUntilUnix
+	.delayUntil = delayUntilUnix,
+	.addWaitFd = addWaitFdUnix,
+	.removeWaitFd = removeWaitFdUnix,
+	.waitUntil = waitUntilUnix,
+	.dispatchWaitFds = dispatchWaitFdsUnix,
+	.getWaitFd = getWaitFdUnix,
+	.postEmptyEvent = postEmptyEventUnix
 };
@@ -0,0 +1,529 @@
+/**
+ * xkbcommon keyboard handling shared by the X11 and Wayland backends.
+ * Copyright (C) 2024  dbstream
+ */
+#include <VKFW/event.h>
+#include <VKFW/logging.h>
+#include <VKFW/platform.h>
+#include <VKFW/vkfw.h>
+#include <VKFW/window.h>
+#include <VKFW/xkb.h>
+
+#include <atomic>
+#include <locale.h>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <system_error>
+#include <thread>
+
+/**
+ * Keycode <--> VKFW_KEY_* lookup tables. These are updated whenever the
+ * keymap changes, so that translation is a single array lookup on every
+ * backend.
+ *
+ * They are only written while translating events, but vkfwTranslateKeycode
+ * and vkfwTranslateKey read them from any thread, so every entry is a relaxed
+ * atomic. A reader may see a mix of the old and the new keymap while it
+ * changes.
+ */
+static std::atomic<int> keycode_lookup[256];
+static std::atomic<int> key_lookup[VKFW_MAX_KEYS];
+
+int
+vkfwXkbTranslateKeycode (int keycode)
+{
+	if (keycode >= 0 && keycode <= 255)
+		return keycode_lookup[keycode].load (std::memory_order_relaxed);
+	return VKFW_KEY_UNKNOWN;
+}
+
+int
+vkfwXkbTranslateKey (int key)
+{
+	if (key >= 0 && key < VKFW_MAX_KEYS)
+		return key_lookup[key].load (std::memory_order_relaxed);
+	return VKFW_KEY_UNKNOWN;
+}
+
+static void
+clear_tables (void)
+{
+	for (int i = 0; i < 256; i++)
+		keycode_lookup[i].store (VKFW_KEY_UNKNOWN, std::memory_order_relaxed);
+	for (int i = 0; i < VKFW_MAX_KEYS; i++)
+		key_lookup[i].store (VKFW_KEY_UNKNOWN, std::memory_order_relaxed);
+}
+
+/**
+ * XKB key names are at most four characters long, so they fit in a uint32_t.
+ */
+static constexpr uint32_t
+pack_name (const char *name)
+{
+	uint32_t v = 0;
+	for (int i = 0; i < 4 && name[i]; i++)
+		v |= (uint32_t) (unsigned char) name[i] << (8 * i);
+	return v;
+}
+
+struct vkfw_xkb_key_table {
+	uint32_t name;
+	int key;
+};
+
+static constexpr vkfw_xkb_key_table key_table[] = {
+	{ pack_name ("SPCE"),	VKFW_KEY_SPACE },
+	{ pack_name ("AE01"),	VKFW_KEY_1 },
+	{ pack_name ("AE02"),	VKFW_KEY_2 },
+	{ pack_name ("AE03"),	VKFW_KEY_3 },
+	{ pack_name ("AE04"),	VKFW_KEY_4 },
+	{ pack_name ("AE05"),	VKFW_KEY_5 },
+	{ pack_name ("AE06"),	VKFW_KEY_6 },
+	{ pack_name ("AE07"),	VKFW_KEY_7 },
+	{ pack_name ("AE08"),	VKFW_KEY_8 },
+	{ pack_name ("AE09"),	VKFW_KEY_9 },
+	{ pack_name ("AE10"),	VKFW_KEY_0 },
+	{ pack_name ("AD01"),	VKFW_KEY_Q },
+	{ pack_name ("AD02"),	VKFW_KEY_W },
+	{ pack_name ("AD03"),	VKFW_KEY_E },
+	{ pack_name ("AD04"),	VKFW_KEY_R },
+	{ pack_name ("AD05"),	VKFW_KEY_T },
+	{ pack_name ("AD06"),	VKFW_KEY_Y },
+	{ pack_name ("AD07"),	VKFW_KEY_U },
+	{ pack_name ("AD08"),	VKFW_KEY_I },
+	{ pack_name ("AD09"),	VKFW_KEY_O },
+	{ pack_name ("AD10"),	VKFW_KEY_P },
+	{ pack_name ("AC01"),	VKFW_KEY_A },
+	{ pack_name ("AC02"),	VKFW_KEY_S },
+	{ pack_name ("AC03"),	VKFW_KEY_D },
+	{ pack_name ("AC04"),	VKFW_KEY_F },
+	{ pack_name ("AC05"),	VKFW_KEY_G },
+	{ pack_name ("AC06"),	VKFW_KEY_H },
+	{ pack_name ("AC07"),	VKFW_KEY_J },
+	{ pack_name ("AC08"),	VKFW_KEY_K },
+	{ pack_name ("AC09"),	VKFW_KEY_L },
+	{ pack_name ("AB01"),	VKFW_KEY_Z },
+	{ pack_name ("AB02"),	VKFW_KEY_X },
+	{ pack_name ("AB03"),	VKFW_KEY_C },
+	{ pack_name ("AB04"),	VKFW_KEY_V },
+	{ pack_name ("AB05"),	VKFW_KEY_B },
+	{ pack_name ("AB06"),	VKFW_KEY_N },
+	{ pack_name ("AB07"),	VKFW_KEY_M },
+	{ pack_name ("LCTL"),	VKFW_KEY_LEFT_CTRL },
+	{ pack_name ("LFSH"),	VKFW_KEY_LEFT_SHIFT },
+	{ pack_name ("LALT"),	VKFW_KEY_LEFT_ALT },
+	{ pack_name ("RCTL"),	VKFW_KEY_RIGHT_CTRL },
+	{ pack_name ("RTSH"),	VKFW_KEY_RIGHT_SHIFT },
+	{ pack_name ("RALT"),	VKFW_KEY_RIGHT_ALT },
+	{ pack_name ("BKSP"),	VKFW_KEY_BACKSPACE },
+	{ pack_name ("INS"),	VKFW_KEY_INSERT },
+	{ pack_name ("DELE"),	VKFW_KEY_DEL },
+	{ pack_name ("HOME"),	VKFW_KEY_HOME },
+	{ pack_name ("END"),	VKFW_KEY_END },
+	{ pack_name ("PGUP"),	VKFW_KEY_PG_UP },
+	{ pack_name ("PGDN"),	VKFW_KEY_PG_DOWN },
+	{ pack_name ("LEFT"),	VKFW_KEY_ARROW_LEFT },
+	{ pack_name ("RGHT"),	VKFW_KEY_ARROW_RIGHT },
+	{ pack_name ("UP"),	VKFW_KEY_ARROW_UP },
+	{ pack_name ("DOWN"),	VKFW_KEY_ARROW_DOWN },
+	{ pack_name ("ESC"),	VKFW_KEY_ESC },
+	{ pack_name ("KP0"),	VKFW_KEY_NUMPAD_0 },
+	{ pack_name ("KP1"),	VKFW_KEY_NUMPAD_1 },
+	{ pack_name ("KP2"),	VKFW_KEY_NUMPAD_2 },
+	{ pack_name ("KP3"),	VKFW_KEY_NUMPAD_3 },
+	{ pack_name ("KP4"),	VKFW_KEY_NUMPAD_4 },
+	{ pack_name ("KP5"),	VKFW_KEY_NUMPAD_5 },
+	{ pack_name ("KP6"),	VKFW_KEY_NUMPAD_6 },
+	{ pack_name ("KP7"),	VKFW_KEY_NUMPAD_7 },
+	{ pack_name ("KP8"),	VKFW_KEY_NUMPAD_8 },
+	{ pack_name ("KP9"),	VKFW_KEY_NUMPAD_9 },
+	{ pack_name ("KPAD"),	VKFW_KEY_NUMPAD_ADD },
+	{ pack_name ("KPSU"),	VKFW_KEY_NUMPAD_SUBTRACT },
+	{ pack_name ("KPDL"),	VKFW_KEY_NUMPAD_COMMA },
+	{ pack_name ("KPMU"),	VKFW_KEY_NUMPAD_MULTIPLY },
+	{ pack_name ("KPDV"),	VKFW_KEY_NUMPAD_DIVIDE },
+	{ pack_name ("KPEN"),	VKFW_KEY_NUMPAD_ENTER },
+	{ pack_name ("FK01"),	VKFW_KEY_F1 },
+	{ pack_name ("FK02"),	VKFW_KEY_F2 },
+	{ pack_name ("FK03"),	VKFW_KEY_F3 },
+	{ pack_name ("FK04"),	VKFW_KEY_F4 },
+	{ pack_name ("FK05"),	VKFW_KEY_F5 },
+	{ pack_name ("FK06"),	VKFW_KEY_F6 },
+	{ pack_name ("FK07"),	VKFW_KEY_F7 },
+	{ pack_name ("FK08"),	VKFW_KEY_F8 },
+	{ pack_name ("FK09"),	VKFW_KEY_F9 },
+	{ pack_name ("FK10"),	VKFW_KEY_F10 },
+	{ pack_name ("FK11"),	VKFW_KEY_F11 },
+	{ pack_name ("FK12"),	VKFW_KEY_F12 },
+	{ pack_name ("FK13"),	VKFW_KEY_F13 },
+	{ pack_name ("FK14"),	VKFW_KEY_F14 },
+	{ pack_name ("FK15"),	VKFW_KEY_F15 },
+	{ pack_name ("FK16"),	VKFW_KEY_F16 },
+	{ pack_name ("FK17"),	VKFW_KEY_F17 },
+	{ pack_name ("FK18"),	VKFW_KEY_F18 },
+	{ pack_name ("FK19"),	VKFW_KEY_F19 },
+	{ pack_name ("FK20"),	VKFW_KEY_F20 },
+	{ pack_name ("FK21"),	VKFW_KEY_F21 },
+	{ pack_name ("FK22"),	VKFW_KEY_F22 },
+	{ pack_name ("FK23"),	VKFW_KEY_F23 },
+	{ pack_name ("FK24"),	VKFW_KEY_F24 },
+	{ pack_name ("FK25"),	VKFW_KEY_F25 }
+};
+
+static constexpr uint32_t num_key_names = sizeof (key_table) / sizeof (key_table[0]);
+
+/**
+ * Perfect hash of the packed key names, computed at compile time. The hash is
+ * (name * mult) >> (32 - VKFW_XKB_HASH_BITS); build_name_hash searches for a
+ * multiplier that doesn't map any two names to the same slot.
+ */
+#define VKFW_XKB_HASH_BITS 10
+#define VKFW_XKB_HASH_SIZE (1U << VKFW_XKB_HASH_BITS)
+#define VKFW_XKB_HASH_EMPTY 0xff
+
+static_assert (num_key_names < VKFW_XKB_HASH_EMPTY, "too many key names for uint8_t slots");
+
+struct vkfw_xkb_name_hash {
+	uint32_t mult;
+	uint8_t slots[VKFW_XKB_HASH_SIZE];
+};
+
+static constexpr uint32_t
+hash_name (uint32_t name, uint32_t mult)
+{
+	return (name * mult) >> (32 - VKFW_XKB_HASH_BITS);
+}
+
+static constexpr vkfw_xkb_name_hash
+build_name_hash (void)
+{
+	vkfw_xkb_name_hash h {};
+	for (uint32_t mult = 0x9e3779b1U; mult < 0x9e3779b1U + 2 * 4096; mult += 2) {
+		for (uint32_t i = 0; i < VKFW_XKB_HASH_SIZE; i++)
+			h.slots[i] = VKFW_XKB_HASH_EMPTY;
+
+		bool ok = true;
+		for (uint32_t i = 0; i < num_key_names && ok; i++) {
+			uint8_t &slot = h.slots[hash_name (key_table[i].name, mult)];
+			if (slot != VKFW_XKB_HASH_EMPTY)
+				ok = false;
+			slot = (uint8_t) i;
+		}
+
+		if (ok) {
+			h.mult = mult;
+			return h;
+		}
+	}
+
+	return h;
+}
+
+static constexpr vkfw_xkb_name_hash name_hash = build_name_hash ();
+static_assert (name_hash.mult, "no perfect hash for the XKB key names");
+
+static int
+name_to_key (const char *name)
+{
+	if (strnlen (name, 5) > 4)
+		return VKFW_KEY_UNKNOWN;
+
+	uint32_t v = pack_name (name);
+	uint8_t i = name_hash.slots[hash_name (v, name_hash.mult)];
+	if (i != VKFW_XKB_HASH_EMPTY && key_table[i].name == v)
+		return key_table[i].key;
+	return VKFW_KEY_UNKNOWN;
+}
+
+/**
+ * Update the lookup tables for keycodes first...last. Keymap changes rarely
+ * change the names of keys, so only entries that actually changed are
+ * touched.
+ */
+static void
+update_tables (VKFWxkbkeyboard *kbd, int first, int last)
+{
+	if (first < 0)
+		first = 0;
+	if (last > 255)
+		last = 255;
+
+	for (int i = first; i <= last; i++) {
+		int key = VKFW_KEY_UNKNOWN;
+		if (xkb_keycode_is_legal_x11 (i)) {
+			const char *name = xkb_keymap_key_get_name (kbd->keymap, i);
+			if (name)
+				key = name_to_key (name);
+		}
+
+		int old_key = keycode_lookup[i].load (std::memory_order_relaxed);
+		if (key == old_key)
+			continue;
+		keycode_lookup[i].store (key, std::memory_order_relaxed);
+
+		/**
+		 * In the inverse table, the lowest keycode wins if several
+		 * keycodes map to the same key.
+		 */
+		if (old_key != VKFW_KEY_UNKNOWN
+			&& key_lookup[old_key].load (std::memory_order_relaxed) == i) {
+			int next = VKFW_KEY_UNKNOWN;
+			for (int j = i + 1; j < 256; j++) {
+				if (keycode_lookup[j].load (std::memory_order_relaxed) == old_key) {
+					next = j;
+					break;
+				}
+			}
+			key_lookup[old_key].store (next, std::memory_order_relaxed);
+		}
+
+		if (key != VKFW_KEY_UNKNOWN) {
+			int cur = key_lookup[key].load (std::memory_order_relaxed);
+			if (cur == VKFW_KEY_UNKNOWN || cur > i)
+				key_lookup[key].store (i, std::memory_order_relaxed);
+		}
+	}
+}
+
+#define VKFW_XKB_DEFINE_FUNC(name) PFN##name name;
+VKFW_XKB_ALL_FUNCS(VKFW_XKB_DEFINE_FUNC)
+#undef VKFW_XKB_DEFINE_FUNC
+
+static void *libxkbcommon_handle;
+
+static bool
+load_xkbcommon (const char *backend_name)
+{
+	libxkbcommon_handle = vkfwCurrentPlatform->loadModule ("libxkbcommon.so.0");
+	if (!libxkbcommon_handle)
+		libxkbcommon_handle = vkfwCurrentPlatform->loadModule ("libxkbcommon.so");
+	if (!libxkbcommon_handle) {
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: %s: libxkbcommon is not present\n", backend_name);
+		return false;
+	}
+
+	bool failed = false;
+#define VKFW_XKB_LOAD_FUNC(name)								\
+	name = (PFN##name) vkfwCurrentPlatform->lookupSymbol (libxkbcommon_handle, #name);	\
+	if (!name)										\
+		failed = true;
+	VKFW_XKB_ALL_FUNCS(VKFW_XKB_LOAD_FUNC)
+#undef VKFW_XKB_LOAD_FUNC
+
+	if (failed) {
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: %s: failed to load some xkbcommon symbols\n", backend_name);
+		vkfwCurrentPlatform->unloadModule (libxkbcommon_handle);
+		return false;
+	}
+
+	return true;
+}
+
+xkb_context *vkfw_xkb_ctx;
+
+/**
+ * Parsing the compose file for the locale takes a noticeable amount of time,
+ * and most sessions never enable text input. The compose table is loaded on
+ * a background thread when text input is first enabled. Until it is ready,
+ * key presses produce text without compose sequences.
+ *
+ * The thread uses its own xkb_context, as contexts are not thread-safe. Text
+ * input can be enabled from any thread, so compose_mu makes sure that the
+ * thread is only started once.
+ */
+static std::atomic<xkb_compose_table *> compose_table;
+static std::mutex compose_mu;
+static std::thread compose_thread;
+static char compose_locale[64];
+static const char *xkb_backend_name;
+
+static void
+load_compose_table (void)
+{
+	xkb_context *ctx = xkb_context_new (XKB_CONTEXT_NO_FLAGS);
+	if (!ctx) {
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: %s: failed to create an XKB context for compose\n",
+			xkb_backend_name);
+		return;
+	}
+
+	xkb_compose_table *table = xkb_compose_table_new_from_locale (ctx,
+		compose_locale, XKB_COMPOSE_COMPILE_NO_FLAGS);
+	xkb_context_unref (ctx);
+	if (!table) {
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: %s: failed to create XKB compose table from locale \"%s\"\n",
+			xkb_backend_name, compose_locale);
+		return;
+	}
+
+	compose_table.store (table, std::memory_order_release);
+}
+
+void
+vkfwXkbEnableTextInput (VKFWwindow *window)
+{
+	(void) window;
+	std::scoped_lock g (compose_mu);
+	if (!vkfw_xkb_ctx || compose_thread.joinable ())
+		return;
+
+	/**
+	 * setlocale is not thread-safe, so look at the locale here rather than
+	 * on the compose thread.
+	 */
+	const char *locale = setlocale (LC_CTYPE, nullptr);
+	if (!locale)
+		locale = "C";
+	snprintf (compose_locale, sizeof (compose_locale), "%s", locale);
+
+	vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: %s: compose_locale=%s\n", xkb_backend_name, compose_locale);
+
+	try {
+		compose_thread = std::thread (load_compose_table);
+	} catch (const std::system_error &) {
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: %s: failed to start the compose thread\n", xkb_backend_name);
+	}
+}
+
+bool
+vkfwXkbInit (const char *backend_name)
+{
+	clear_tables ();
+
+	if (!load_xkbcommon (backend_name))
+		return false;
+
+	vkfw_xkb_ctx = xkb_context_new (XKB_CONTEXT_NO_FLAGS);
+	if (!vkfw_xkb_ctx) {
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: %s: failed to create an XKB context\n", backend_name);
+		vkfwCurrentPlatform->unloadModule (libxkbcommon_handle);
+		return false;
+	}
+
+	xkb_context_set_log_level (vkfw_xkb_ctx, XKB_LOG_LEVEL_DEBUG);
+	xkb_backend_name = backend_name;
+	return true;
+}
+
+void
+vkfwXkbTerminate (void)
+{
+	if (compose_thread.joinable ())
+		compose_thread.join ();
+
+	xkb_compose_table *table = compose_table.exchange (nullptr, std::memory_order_acquire);
+	if (table)
+		xkb_compose_table_unref (table);
+
+	xkb_context_unref (vkfw_xkb_ctx);
+	vkfw_xkb_ctx = nullptr;
+	vkfwCurrentPlatform->unloadModule (libxkbcommon_handle);
+	clear_tables ();
+}
+
+static const char *const modifier_names[VKFW_XKB_NUM_MODS] = {
+	XKB_MOD_NAME_CTRL,	/** VKFW_MODIFIER_CTRL */
+	XKB_MOD_NAME_SHIFT,	/** VKFW_MODIFIER_SHIFT */
+	XKB_MOD_NAME_ALT,	/** VKFW_MODIFIER_LEFT_ALT */
+	"Mod3",			/** VKFW_MODIFIER_RIGHT_ALT */
+	XKB_MOD_NAME_CAPS,	/** VKFW_MODIFIER_CAPS_LOCK */
+	XKB_MOD_NAME_NUM	/** VKFW_MODIFIER_NUM_LOCK */
+};
+
+bool
+vkfwXkbSetKeymap (VKFWxkbkeyboard *kbd, xkb_keymap *keymap, xkb_state *state,
+	int first, int last)
+{
+	xkb_state_unref (kbd->state);
+	xkb_keymap_unref (kbd->keymap);
+	kbd->keymap = keymap;
+	kbd->state = state;
+	if (kbd->compose)
+		xkb_compose_state_reset (kbd->compose);
+
+	for (int i = 0; i < VKFW_XKB_NUM_MODS; i++)
+		kbd->mods[i] = xkb_keymap_mod_get_index (keymap, modifier_names[i]);
+
+	update_tables (kbd, first, last);
+	return true;
+}
+
+void
+vkfwXkbReleaseKeyboard (VKFWxkbkeyboard *kbd)
+{
+	xkb_compose_state_unref (kbd->compose);
+	xkb_state_unref (kbd->state);
+	xkb_keymap_unref (kbd->keymap);
+	kbd->compose = nullptr;
+	kbd->state = nullptr;
+	kbd->keymap = nullptr;
+}
+
+void
+vkfwXkbKeyPress (VKFWxkbkeyboard *kbd, const VKFWevent *e)
+{
+	if (!kbd->state)
+		return;
+
+	if (!(e->window->flags & VKFW_WINDOW_TEXT_INPUT_ENABLED))
+		return;
+
+	xkb_keysym_t keysym = xkb_state_key_get_one_sym (kbd->state, e->keycode);
+	if (!keysym)
+		return;
+
+	if (!kbd->compose) {
+		xkb_compose_table *table = compose_table.load (std::memory_order_acquire);
+		if (table)
+			kbd->compose = xkb_compose_state_new (table, XKB_COMPOSE_STATE_NO_FLAGS);
+	}
+
+	if (kbd->compose) {
+		xkb_compose_state_feed (kbd->compose, keysym);
+		xkb_compose_status status = xkb_compose_state_get_status (kbd->compose);
+
+		if (status == XKB_COMPOSE_CANCELLED) {
+			xkb_compose_state_reset (kbd->compose);
+			keysym = 0;
+		} else if (status == XKB_COMPOSE_COMPOSED) {
+			/**
+			 * A compose sequence can produce a string rather than
+			 * a single keysym.
+			 */
+			char text[64];
+			int len = xkb_compose_state_get_utf8 (kbd->compose, text, sizeof (text));
+			keysym = xkb_compose_state_get_one_sym (kbd->compose);
+			xkb_compose_state_reset (kbd->compose);
+
+			if (len > 0 && (size_t) len < sizeof (text)) {
+				vkfwQueueTextInput (e->window, text, len,
+					e->x, e->y, e->modifiers);
+				return;
+			}
+		} else if (status != XKB_COMPOSE_NOTHING)
+			keysym = 0;
+	}
+
+	if (keysym) {
+		uint32_t codepoint = xkb_keysym_to_utf32 (keysym);
+		if (codepoint)
+			vkfwQueueTextInputEvent (e->window, codepoint,
+				e->x, e->y, e->modifiers);
+	}
+}
+
+unsigned int
+vkfwXkbGetModifiers (VKFWxkbkeyboard *kbd)
+{
+	unsigned int modifiers = 0;
+	if (!kbd->state)
+		return 0;
+
+	for (int i = 0; i < VKFW_XKB_NUM_MODS; i++) {
+		if (kbd->mods[i] != XKB_MOD_INVALID && xkb_state_mod_index_is_active (
+			kbd->state, kbd->mods[i], XKB_STATE_MODS_EFFECTIVE) > 0)
+			modifiers |= 1U << i;
+	}
+	return modifiers;
+}
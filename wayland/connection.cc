@@ -8,6 +8,7 @@
 #include <VKFW/platform.h>
 #include <VKFW/vkfw.h>
 #include <VKFW/window_api.h>
+#include <VKFW/xkb.h>
 #include "event.h"
 #include "input.h"
 #include "wayland.h"
@@ -23,13 +24,18 @@
 #include <unistd.h>
 
 wl_display *vkfwWlDisplay;
+wl_event_queue *vkfwWlQueue;
 wl_registry *vkfwWlRegistry;
 wl_compositor *vkfwWlCompositor;
 wl_subcompositor *vkfwWlSubcompositor;
 wl_shm *vkfwWlShm;
 wp_viewporter *vkfwWpViewporter;
+wp_presentation *vkfwWpPresentation;
+clockid_t vkfwWpPresentationClock = CLOCK_MONOTONIC;
 xdg_wm_base *vkfwXdgWmBase;
 zxdg_decoration_manager_v1 *vkfwZxdgDecorationManagerV1;
+zwp_relative_pointer_manager_v1 *vkfwZwpRelativePointerManagerV1;
+zwp_pointer_constraints_v1 *vkfwZwpPointerConstraintsV1;
 
 bool vkfwWlSupportCSD;
 
@@ -82,8 +88,12 @@ static uint32_t vkfwWlSeatId;
 static uint32_t vkfwWlSubcompositorId;
 static uint32_t vkfwWlShmId;
 static uint32_t vkfwWpViewporterId;
+static uint32_t vkfwWpPresentationId;
 static uint32_t vkfwXdgWmBaseId;
+static uint32_t vkfwXdgWmBaseVersion;
 static uint32_t vkfwZxdgDecorationManagerV1Id;
+static uint32_t vkfwZwpRelativePointerManagerV1Id;
+static uint32_t vkfwZwpPointerConstraintsV1Id;
 
 static void
 handle_wm_base_ping (void *data, xdg_wm_base *wm_base, uint32_t serial)
@@ -96,13 +106,24 @@ static const struct xdg_wm_base_listener wm_base_listener = {
 	.ping = handle_wm_base_ping
 };
 
+static void
+handle_presentation_clock_id (void *data, wp_presentation *presentation, uint32_t clk_id)
+{
+	(void) data;
+	(void) presentation;
+	vkfwWpPresentationClock = (clockid_t) clk_id;
+}
+
+static const struct wp_presentation_listener presentation_listener = {
+	.clock_id = handle_presentation_clock_id
+};
+
 static void
 handle_registry_global (void *data, wl_registry *registry,
 	uint32_t name, const char *interface, uint32_t version)
 {
 	(void) data;
 	(void) registry;
-	(void) version;
 
 	vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: interface %s v%u <%u>\n", interface, version, name);
 	if (!strcmp (interface, "wl_compositor"))
@@ -115,10 +136,17 @@ handle_registry_global (void *data, wl_registry *registry,
 		vkfwWlShmId = name;
 	else if (!strcmp (interface, "wp_viewporter"))
 		vkfwWpViewporterId = name;
-	else if (!strcmp (interface, "xdg_wm_base"))
+	else if (!strcmp (interface, "wp_presentation"))
+		vkfwWpPresentationId = name;
+	else if (!strcmp (interface, "xdg_wm_base")) {
 		vkfwXdgWmBaseId = name;
-	else if (!strcmp (interface, "zxdg_decoration_manager_v1"))
+		vkfwXdgWmBaseVersion = version;
+	} else if (!strcmp (interface, "zxdg_decoration_manager_v1"))
 		vkfwZxdgDecorationManagerV1Id = name;
+	else if (!strcmp (interface, "zwp_relative_pointer_manager_v1"))
+		vkfwZwpRelativePointerManagerV1Id = name;
+	else if (!strcmp (interface, "zwp_pointer_constraints_v1"))
+		vkfwZwpPointerConstraintsV1Id = name;
 }
 
 static void
@@ -226,10 +254,18 @@ setup_shm (void)
 static void
 vkfwWlClose (void)
 {
+	vkfwCurrentPlatform->removeWaitFd (wl_display_get_fd (vkfwWlDisplay));
+	vkfwWlTerminateEvents ();
 	vkfwWlTerminateInput ();
 	wl_buffer_destroy (vkfwWlCloseButtonBuffer);
 	wl_buffer_destroy (vkfwWlCursorBuffer);
 	wl_buffer_destroy (vkfwWlFrameBuffer);
+	if (vkfwWpPresentation)
+		wp_presentation_destroy (vkfwWpPresentation);
+	if (vkfwZwpPointerConstraintsV1)
+		zwp_pointer_constraints_v1_destroy (vkfwZwpPointerConstraintsV1);
+	if (vkfwZwpRelativePointerManagerV1)
+		zwp_relative_pointer_manager_v1_destroy (vkfwZwpRelativePointerManagerV1);
 	if (vkfwWpViewporter)
 		wp_viewporter_destroy (vkfwWpViewporter);
 	if (vkfwWlSubcompositor)
@@ -240,6 +276,7 @@ vkfwWlClose (void)
 	xdg_wm_base_destroy (vkfwXdgWmBase);
 	wl_compositor_destroy (vkfwWlCompositor);
 	wl_registry_destroy (vkfwWlRegistry);
+	wl_event_queue_destroy (vkfwWlQueue);
 	wl_display_disconnect (vkfwWlDisplay);
 	unload_wayland_funcs ();
 }
@@ -264,17 +301,34 @@ vkfwWlOpen (void)
 
 	vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Using Wayland backend\n");
 
-	vkfwWlRegistry = wl_display_get_registry (vkfwWlDisplay);
+	vkfwWlQueue = wl_display_create_queue_with_name (vkfwWlDisplay, "vkfw");
+	if (!vkfwWlQueue) {
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: wl_display_create_queue returned nullptr\n");
+		wl_display_disconnect (vkfwWlDisplay);
+		unload_wayland_funcs ();
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	wl_display *display_wrapper = (wl_display *) wl_proxy_create_wrapper (vkfwWlDisplay);
+	if (display_wrapper) {
+		wl_proxy_set_queue ((wl_proxy *) display_wrapper, vkfwWlQueue);
+		vkfwWlRegistry = wl_display_get_registry (display_wrapper);
+		wl_proxy_wrapper_destroy (display_wrapper);
+	}
+
 	if (!vkfwWlRegistry) {
 		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: wl_display_get_registry returned nullptr\n");
+		wl_event_queue_destroy (vkfwWlQueue);
+		wl_display_disconnect (vkfwWlDisplay);
 		unload_wayland_funcs ();
 		return VK_ERROR_INITIALIZATION_FAILED;
 	}
 
 	wl_registry_add_listener (vkfwWlRegistry, &registry_listener, nullptr);
-	if (wl_display_roundtrip (vkfwWlDisplay) == -1) {
+	if (wl_display_roundtrip_queue (vkfwWlDisplay, vkfwWlQueue) == -1) {
 		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: wl_display_roundtrip failed\n");
 		wl_registry_destroy (vkfwWlRegistry);
+		wl_event_queue_destroy (vkfwWlQueue);
 		wl_display_disconnect (vkfwWlDisplay);
 		unload_wayland_funcs ();
 		return VK_ERROR_INITIALIZATION_FAILED;
@@ -285,12 +339,16 @@ vkfwWlOpen (void)
 	vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: wl_subcompositor=%u\n", vkfwWlSubcompositorId);
 	vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: wl_shm=%u\n", vkfwWlShmId);
 	vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: wp_viewporter=%u\n", vkfwWpViewporterId);
+	vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: wp_presentation=%u\n", vkfwWpPresentationId);
 	vkfwPrintf (VKFW_LOG_BACKEND, "VKWF: Wayland: xdg_wm_base=%u\n", vkfwXdgWmBaseId);
 	vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: zxdg_decoration_manager_v1=%u\n", vkfwZxdgDecorationManagerV1Id);
+	vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: zwp_relative_pointer_manager_v1=%u\n", vkfwZwpRelativePointerManagerV1Id);
+	vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: zwp_pointer_constraints_v1=%u\n", vkfwZwpPointerConstraintsV1Id);
 
 	if (!vkfwWlCompositorId || !vkfwXdgWmBaseId || !vkfwWlShmId) {
 		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: required protocols are not supported\n");
 		wl_registry_destroy (vkfwWlRegistry);
+		wl_event_queue_destroy (vkfwWlQueue);
 		wl_display_disconnect (vkfwWlDisplay);
 		unload_wayland_funcs ();
 		return VK_ERROR_INITIALIZATION_FAILED;
@@ -299,7 +357,8 @@ vkfwWlOpen (void)
 	vkfwWlCompositor = (wl_compositor *) wl_registry_bind (vkfwWlRegistry,
 		vkfwWlCompositorId, &wl_compositor_interface, 5);
 	vkfwXdgWmBase = (xdg_wm_base *) wl_registry_bind (vkfwWlRegistry,
-		vkfwXdgWmBaseId, &xdg_wm_base_interface, 5);
+		vkfwXdgWmBaseId, &xdg_wm_base_interface,
+		vkfwXdgWmBaseVersion >= 6 ? 6 : 5);
 
 	if (!vkfwWlCompositor || !vkfwXdgWmBase)  {
 		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: failed to create required objects\n");
@@ -308,6 +367,7 @@ vkfwWlOpen (void)
 		else if (vkfwXdgWmBase)
 			xdg_wm_base_destroy (vkfwXdgWmBase);
 		wl_registry_destroy (vkfwWlRegistry);
+		wl_event_queue_destroy (vkfwWlQueue);
 		wl_display_disconnect (vkfwWlDisplay);
 		unload_wayland_funcs ();
 		return VK_ERROR_INITIALIZATION_FAILED;
@@ -347,9 +407,49 @@ vkfwWlOpen (void)
 	} else
 		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: wp_viewporter is not available; CSD will be disabled\n");
 
+	/**
+	 * The pointer protocols are optional; without them, VKFW_POINTER_RELATIVE,
+	 * VKFW_POINTER_CONFINED and VKFW_POINTER_GRABBED have no effect.
+	 */
+	if (vkfwZwpRelativePointerManagerV1Id) {
+		vkfwZwpRelativePointerManagerV1 = (zwp_relative_pointer_manager_v1 *) wl_registry_bind (
+			vkfwWlRegistry, vkfwZwpRelativePointerManagerV1Id, &zwp_relative_pointer_manager_v1_interface, 1);
+		if (!vkfwZwpRelativePointerManagerV1)
+			vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: failed to create relative pointer manager\n");
+	} else
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: zwp_relative_pointer_manager_v1 is not available; relative pointer mode will be disabled\n");
+
+	if (vkfwZwpPointerConstraintsV1Id) {
+		vkfwZwpPointerConstraintsV1 = (zwp_pointer_constraints_v1 *) wl_registry_bind (
+			vkfwWlRegistry, vkfwZwpPointerConstraintsV1Id, &zwp_pointer_constraints_v1_interface, 1);
+		if (!vkfwZwpPointerConstraintsV1)
+			vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: failed to create pointer constraints\n");
+	} else
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: zwp_pointer_constraints_v1 is not available; the pointer cannot be locked or confined\n");
+
+	/**
+	 * The compositor sends clock_id right after the bind, so we have it
+	 * after the roundtrip below.
+	 */
+	if (vkfwWpPresentationId) {
+		vkfwWpPresentation = (wp_presentation *) wl_registry_bind (
+			vkfwWlRegistry, vkfwWpPresentationId, &wp_presentation_interface, 1);
+		if (vkfwWpPresentation)
+			wp_presentation_add_listener (vkfwWpPresentation, &presentation_listener, nullptr);
+		else
+			vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: failed to create presentation\n");
+	} else
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: wp_presentation is not available; presentation feedback will be disabled\n");
+
 	xdg_wm_base_add_listener (vkfwXdgWmBase, &wm_base_listener, nullptr);
-	if (wl_display_roundtrip (vkfwWlDisplay) == -1) {
+	if (wl_display_roundtrip_queue (vkfwWlDisplay, vkfwWlQueue) == -1) {
 		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: wl_display_roundtrip failed\n");
+		if (vkfwWpPresentation)
+			wp_presentation_destroy (vkfwWpPresentation);
+		if (vkfwZwpPointerConstraintsV1)
+			zwp_pointer_constraints_v1_destroy (vkfwZwpPointerConstraintsV1);
+		if (vkfwZwpRelativePointerManagerV1)
+			zwp_relative_pointer_manager_v1_destroy (vkfwZwpRelativePointerManagerV1);
 		if (vkfwWpViewporter)
 			wp_viewporter_destroy (vkfwWpViewporter);
 		if (vkfwWlShm)
@@ -361,6 +461,7 @@ vkfwWlOpen (void)
 		xdg_wm_base_destroy (vkfwXdgWmBase);
 		wl_compositor_destroy (vkfwWlCompositor);
 		wl_registry_destroy (vkfwWlRegistry);
+		wl_event_queue_destroy (vkfwWlQueue);
 		wl_display_disconnect (vkfwWlDisplay);
 		unload_wayland_funcs ();
 		return VK_ERROR_INITIALIZATION_FAILED;
@@ -370,6 +471,12 @@ vkfwWlOpen (void)
 		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: failed to send buffers to the compositor\n");
 		if (vkfwWlSupportCSD)
 			wl_buffer_destroy (vkfwWlFrameBuffer);
+		if (vkfwWpPresentation)
+			wp_presentation_destroy (vkfwWpPresentation);
+		if (vkfwZwpPointerConstraintsV1)
+			zwp_pointer_constraints_v1_destroy (vkfwZwpPointerConstraintsV1);
+		if (vkfwZwpRelativePointerManagerV1)
+			zwp_relative_pointer_manager_v1_destroy (vkfwZwpRelativePointerManagerV1);
 		if (vkfwWpViewporter)
 			wp_viewporter_destroy (vkfwWpViewporter);
 		if (vkfwWlSubcompositor)
@@ -380,6 +487,7 @@ vkfwWlOpen (void)
 		xdg_wm_base_destroy (vkfwXdgWmBase);
 		wl_compositor_destroy (vkfwWlCompositor);
 		wl_registry_destroy (vkfwWlRegistry);
+		wl_event_queue_destroy (vkfwWlQueue);
 		wl_display_disconnect (vkfwWlDisplay);
 		unload_wayland_funcs ();
 	}
@@ -392,10 +500,23 @@ vkfwWlOpen (void)
 	if (vkfwZxdgDecorationManagerV1)
 		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: zxdg_decoration_manager_v1 is supported\n");
 
-	VkResult result = vkfwWlInitializeInput (vkfwWlSeatId);
+	VkResult result = vkfwCurrentPlatform->addWaitFd (
+		wl_display_get_fd (vkfwWlDisplay), VKFW_FD_READABLE, nullptr, nullptr);
+	if (result == VK_SUCCESS) {
+		result = vkfwWlInitializeInput (vkfwWlSeatId);
+		if (result != VK_SUCCESS)
+			vkfwCurrentPlatform->removeWaitFd (wl_display_get_fd (vkfwWlDisplay));
+	}
+
 	if (result != VK_SUCCESS) {
 		if (vkfwWlSupportCSD)
 			wl_buffer_destroy (vkfwWlFrameBuffer);
+		if (vkfwWpPresentation)
+			wp_presentation_destroy (vkfwWpPresentation);
+		if (vkfwZwpPointerConstraintsV1)
+			zwp_pointer_constraints_v1_destroy (vkfwZwpPointerConstraintsV1);
+		if (vkfwZwpRelativePointerManagerV1)
+			zwp_relative_pointer_manager_v1_destroy (vkfwZwpRelativePointerManagerV1);
 		if (vkfwWpViewporter)
 			wp_viewporter_destroy (vkfwWpViewporter);
 		if (vkfwWlSubcompositor)
@@ -406,6 +527,7 @@ vkfwWlOpen (void)
 		xdg_wm_base_destroy (vkfwXdgWmBase);
 		wl_compositor_destroy (vkfwWlCompositor);
 		wl_registry_destroy (vkfwWlRegistry);
+		wl_event_queue_destroy (vkfwWlQueue);
 		wl_display_disconnect (vkfwWlDisplay);
 		unload_wayland_funcs ();
 		return result;
@@ -426,7 +548,17 @@ VKFWwindowbackend vkfwBackendWayland = {
 	.show_window = vkfwWlShowWindow,
 	.hide_window = vkfwWlHideWindow,
 	.set_title = vkfwWlSetWindowTitle,
-	.dispatch_events = vkfwWlDispatchEvents
+	.translate_keycode = vkfwXkbTranslateKeycode,
+	.translate_key = vkfwXkbTranslateKey,
+	.enable_text_input = vkfwXkbEnableTextInput,
+	.update_pointer_mode = vkfwWlUpdatePointerMode,
+	.request_frame = vkfwWlRequestFrame,
+	.request_presentation_feedback = vkfwWlRequestPresentationFeedback,
+	.dispatch_events = vkfwWlDispatchEvents,
+	.init_input_thread = vkfwWlInitInputThread,
+	.wait_input = vkfwWlWaitInput,
+	.wake_input_thread = vkfwWlWakeInputThread,
+	.cancel_input_thread = vkfwWlCancelInputThread
 };
 
 #define VKFW_WL_DEFINE_FUNC(name) PFN##name name;
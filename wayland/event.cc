@@ -2,54 +2,156 @@
  * Wayland event dispatching.
  * Copyright (C) 2024  dbstream
  */
+#include <VKFW/event.h>
+#include <VKFW/logging.h>
+#include <VKFW/platform.h>
 #include <VKFW/vkfw.h>
 #include "event.h"
+#include "input.h"
 #include "wayland.h"
 
-#include <sys/poll.h>
 #include <errno.h>
+#include <mutex>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
+/**
+ * The event pump never blocks on the compositor. Each iteration dispatches
+ * what libwayland has already queued, takes the read intent, and then reads
+ * from the socket. wl_display_read_events does not block if the socket has
+ * no data, so a POLL with nothing pending costs one recvmsg.
+ *
+ * The input lock is only held while dispatching, as listeners translate
+ * events. Another thread that does a roundtrip with the lock held waits for
+ * us to read the socket, so we must not try to take the lock between
+ * preparing to read and reading.
+ */
 VkResult
 vkfwWlDispatchEvents (int mode, uint64_t timeout)
 {
-	if (mode == VKFW_EVENT_MODE_TIMEOUT && timeout)
+	if (mode == VKFW_EVENT_MODE_TIMEOUT && timeout && timeout != UINT64_MAX)
 		timeout += vkfwGetTime ();
 
-	/**
-	 * FIXME: can we remove wl_display_roundtrip from this loop somehow?
-	 */
-
 	for (;;) {
-		if (wl_display_roundtrip (vkfwWlDisplay) == -1)
-			return VK_ERROR_UNKNOWN;
-
-		if (!timeout || vkfwGetTime () >= timeout)
-			return VK_SUCCESS;
-
-		while (wl_display_prepare_read(vkfwWlDisplay) != 0)
-			if (wl_display_dispatch_pending (vkfwWlDisplay) == -1)
+		std::unique_lock g (vkfw_input_mu);
+		while (wl_display_prepare_read_queue (vkfwWlDisplay, vkfwWlQueue) != 0) {
+			if (wl_display_dispatch_queue_pending (vkfwWlDisplay, vkfwWlQueue) == -1)
 				return VK_ERROR_UNKNOWN;
 
-		if (wl_display_flush (vkfwWlDisplay) == -1) {
+			g.unlock ();
+			vkfwFlushEvents ();
+			g.lock ();
+		}
+
+		/**
+		 * EAGAIN means that the socket buffer is full. Whatever is
+		 * left will be flushed on the next iteration.
+		 */
+		if (wl_display_flush (vkfwWlDisplay) == -1 && errno != EAGAIN) {
 			wl_display_cancel_read (vkfwWlDisplay);
-			if (errno == EAGAIN)
-				continue;
 			return VK_ERROR_UNKNOWN;
 		}
 
-		uint64_t now = vkfwGetTime ();
-		if (now + 999 >= timeout)  {
-			wl_display_cancel_read (vkfwWlDisplay);
+		bool block = timeout && vkfwGetTime () < timeout
+			&& !vkfwShouldStopDispatch ();
+		g.unlock ();
+		if (block)
+			vkfwCurrentPlatform->waitUntil (timeout);
+
+		if (wl_display_read_events (vkfwWlDisplay) == -1)
+			return VK_ERROR_UNKNOWN;
+
+		g.lock ();
+		if (wl_display_dispatch_queue_pending (vkfwWlDisplay, vkfwWlQueue) == -1)
+			return VK_ERROR_UNKNOWN;
+		vkfwWlDispatchKeyRepeat ();
+		g.unlock ();
+
+		vkfwFlushEvents ();
+
+		if (!block)
 			return VK_SUCCESS;
-		}
+	}
+}
+
+/**
+ *   Input thread support.
+ *
+ * The input thread waits for the display fd and the key repeat timer in
+ * vkfwWlWaitInput, and then calls vkfwWlDispatchEvents in POLL mode. As all
+ * of our proxies are on vkfwWlQueue, this never runs
+ * listeners that belong to the Vulkan WSI. wake_fd interrupts the wait.
+ */
+static int wake_fd = -1;
+
+VkResult
+vkfwWlInitInputThread (void)
+{
+	wake_fd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (wake_fd == -1) {
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: eventfd failed with errno %d\n", errno);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
 
-		struct pollfd fds[] = {
-			{ wl_display_get_fd (vkfwWlDisplay), POLLIN, 0 }
-		};
+	vkfwCurrentPlatform->removeWaitFd (wl_display_get_fd (vkfwWlDisplay));
+	vkfwCurrentPlatform->removeWaitFd (vkfwWlGetKeyRepeatFd ());
+	return VK_SUCCESS;
+}
+
+VkResult
+vkfwWlWaitInput (void)
+{
+	if (wl_display_prepare_read_queue (vkfwWlDisplay, vkfwWlQueue) != 0)
+		return VK_SUCCESS;
 
-		poll (fds, 1, (timeout - now + 999) / 1000);
+	if (wl_display_flush (vkfwWlDisplay) == -1 && errno != EAGAIN) {
 		wl_display_cancel_read (vkfwWlDisplay);
-		if (!(fds[0].revents & POLLIN))
-			return VK_SUCCESS;
+		return VK_ERROR_UNKNOWN;
+	}
+
+	struct pollfd fds[3] = {
+		{ wl_display_get_fd (vkfwWlDisplay), POLLIN, 0 },
+		{ wake_fd, POLLIN, 0 },
+		{ vkfwWlGetKeyRepeatFd (), POLLIN, 0 }
+	};
+	while (poll (fds, 3, -1) == -1 && errno == EINTR);
+
+	if (fds[1].revents & POLLIN) {
+		uint64_t value;
+		while (read (wake_fd, &value, sizeof (value)) == -1 && errno == EINTR);
+	}
+
+	wl_display_cancel_read (vkfwWlDisplay);
+	return VK_SUCCESS;
+}
+
+void
+vkfwWlWakeInputThread (void)
+{
+	uint64_t value = 1;
+	while (write (wake_fd, &value, sizeof (value)) == -1 && errno == EINTR);
+}
+
+void
+vkfwWlCancelInputThread (void)
+{
+	close (wake_fd);
+	wake_fd = -1;
+
+	if (vkfwCurrentPlatform->addWaitFd (wl_display_get_fd (vkfwWlDisplay),
+		VKFW_FD_READABLE, nullptr, nullptr) != VK_SUCCESS
+		|| vkfwCurrentPlatform->addWaitFd (vkfwWlGetKeyRepeatFd (),
+		VKFW_FD_READABLE, nullptr, nullptr) != VK_SUCCESS)
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: failed to add the display back to the wait set\n");
+}
+
+void
+vkfwWlTerminateEvents (void)
+{
+	if (wake_fd != -1) {
+		close (wake_fd);
+		wake_fd = -1;
 	}
 }
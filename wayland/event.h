@@ -6,3 +6,18 @@
 
 VkResult
 vkfwWlDispatchEvents (int mode, uint64_t timeout);
+
+VkResult
+vkfwWlInitInputThread (void);
+
+VkResult
+vkfwWlWaitInput (void);
+
+void
+vkfwWlWakeInputThread (void);
+
+void
+vkfwWlCancelInputThread (void);
+
+void
+vkfwWlTerminateEvents (void);
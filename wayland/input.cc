@@ -8,7 +8,13 @@
  */
 #include <VKFW/event.h>
 #include <VKFW/logging.h>
+#include <VKFW/platform.h>
 #include <VKFW/window.h>
+#include <VKFW/xkb.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 #include "input.h"
 #include "wayland.h"
@@ -18,17 +24,37 @@
 
 static wl_seat *seat;
 static wl_pointer *ptr_dev;
+static zwp_relative_pointer_v1 *relative_ptr_dev;
 static wl_keyboard *kbd_dev;
 
 static wl_surface *cursor_surface;
 
 static VKFWwlwindow *ptr_focus_window;
 static wl_surface *ptr_focus;
+static uint32_t ptr_enter_serial;
 static int ptr_x, ptr_y;
 
+/**
+ * Sub-pixel remainder of relative motion. VKFWevent carries whole pixels, so
+ * the fractional part of each delta is kept for the next event rather than
+ * being truncated away.
+ */
+static wl_fixed_t rel_x, rel_y;
+
 static VKFWwlwindow *kbd_focus_window;
 static wl_surface *kbd_focus;
 
+/**
+ * wl_pointer and wl_keyboard belong to the seat, so we can't stop the
+ * compositor from sending events for a window that doesn't want them. We can
+ * at least skip translating them and not run key repeat for such windows.
+ */
+static bool
+window_wants (VKFWwlwindow *window, unsigned int mask)
+{
+	return window && (window->window.event_mask & mask);
+}
+
 static void
 ptr_defocus (void)
 {
@@ -38,9 +64,12 @@ ptr_defocus (void)
 	}
 }
 
+static void stop_repeat (void);
+
 static void
 kbd_defocus (void)
 {
+	stop_repeat ();
 	if (kbd_focus_window) {
 		VKFWevent e {};
 		e.type = VKFW_EVENT_WINDOW_LOST_FOCUS;
@@ -52,6 +81,33 @@ kbd_defocus (void)
 	}
 }
 
+static bool
+ptr_in_content (void)
+{
+	return ptr_focus_window && ptr_focus == ptr_focus_window->content_surface;
+}
+
+/**
+ * Absolute motion is not reported in relative mode, unless we can't report
+ * relative motion instead.
+ */
+static bool
+ptr_is_relative (void)
+{
+	return relative_ptr_dev && ptr_in_content ()
+		&& (ptr_focus_window->pointer_mode & VKFW_POINTER_RELATIVE);
+}
+
+static void
+update_cursor (void)
+{
+	wl_surface *surface = cursor_surface;
+	if (ptr_in_content () && (ptr_focus_window->pointer_mode & VKFW_POINTER_HIDDEN))
+		surface = nullptr;
+
+	wl_pointer_set_cursor (ptr_dev, ptr_enter_serial, surface, 3, 2);
+}
+
 static void
 handle_ptr_enter (void *data, wl_pointer *dev, uint32_t serial,
 	wl_surface *surface, wl_fixed_t x, wl_fixed_t y)
@@ -60,13 +116,17 @@ handle_ptr_enter (void *data, wl_pointer *dev, uint32_t serial,
 	if (ptr_focus_window) {
 		vkfwRefWindow ((VKFWwindow *) ptr_focus_window);
 		ptr_focus = surface;
+		ptr_enter_serial = serial;
 		ptr_x = wl_fixed_to_int (x);
 		ptr_y = wl_fixed_to_int (y);
+		rel_x = 0;
+		rel_y = 0;
 
-		wl_pointer_set_cursor (dev, serial, cursor_surface, 3, 2);
+		update_cursor ();
 	}
 
-	if (ptr_focus_window && ptr_focus == ptr_focus_window->content_surface) {
+	if (ptr_in_content () && !ptr_is_relative ()
+		&& window_wants (ptr_focus_window, VKFW_EVENT_BIT (VKFW_EVENT_POINTER_MOTION))) {
 		VKFWevent e {};
 		e.type = VKFW_EVENT_POINTER_MOTION;
 		e.window = (VKFWwindow *) ptr_focus_window;
@@ -90,7 +150,7 @@ handle_ptr_motion (void *data, wl_pointer *dev, uint32_t time,
 	ptr_x = wl_fixed_to_int (x);
 	ptr_y = wl_fixed_to_int (y);
 
-	if (ptr_focus_window && ptr_focus == ptr_focus_window->content_surface) {
+	if (ptr_in_content () && !ptr_is_relative ()) {
 		VKFWevent e {};
 		e.type = VKFW_EVENT_POINTER_MOTION;
 		e.window = (VKFWwindow *) ptr_focus_window;
@@ -222,6 +282,71 @@ handle_ptr_axis_relative_direction (void *data, wl_pointer *dev, uint32_t axis,
 
 }
 
+/**
+ * Take the whole pixels out of a wl_fixed_t accumulator.
+ */
+static int
+take_whole_pixels (wl_fixed_t *acc, wl_fixed_t delta)
+{
+	*acc += delta;
+	int whole = *acc / 256;
+	*acc -= whole * 256;
+	return whole;
+}
+
+static void
+handle_relative_motion (void *data, zwp_relative_pointer_v1 *dev,
+	uint32_t utime_hi, uint32_t utime_lo, wl_fixed_t dx, wl_fixed_t dy,
+	wl_fixed_t dx_unaccel, wl_fixed_t dy_unaccel)
+{
+	(void) data;
+	(void) dev;
+	(void) utime_hi;
+	(void) utime_lo;
+	(void) dx;
+	(void) dy;
+
+	if (!ptr_is_relative ()
+		|| !window_wants (ptr_focus_window, VKFW_EVENT_BIT (VKFW_EVENT_RELATIVE_POINTER_MOTION)))
+		return;
+
+	VKFWevent e {};
+	e.type = VKFW_EVENT_RELATIVE_POINTER_MOTION;
+	e.window = (VKFWwindow *) ptr_focus_window;
+	e.x = take_whole_pixels (&rel_x, dx_unaccel);
+	e.y = take_whole_pixels (&rel_y, dy_unaccel);
+	if (e.x || e.y)
+		vkfwSendEventToApplication (&e);
+}
+
+static const struct zwp_relative_pointer_v1_listener relative_pointer_listener = {
+	.relative_motion = handle_relative_motion
+};
+
+static void
+create_relative_pointer (void)
+{
+	if (!vkfwZwpRelativePointerManagerV1)
+		return;
+
+	relative_ptr_dev = zwp_relative_pointer_manager_v1_get_relative_pointer (
+		vkfwZwpRelativePointerManagerV1, ptr_dev);
+	if (relative_ptr_dev)
+		zwp_relative_pointer_v1_add_listener (relative_ptr_dev,
+			&relative_pointer_listener, nullptr);
+	else
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: failed to create relative pointer device\n");
+}
+
+static void
+destroy_relative_pointer (void)
+{
+	if (relative_ptr_dev) {
+		zwp_relative_pointer_v1_destroy (relative_ptr_dev);
+		relative_ptr_dev = nullptr;
+	}
+}
+
 static const struct wl_pointer_listener pointer_listener = {
 	.enter = handle_ptr_enter,
 	.leave = handle_ptr_leave,
@@ -236,20 +361,167 @@ static const struct wl_pointer_listener pointer_listener = {
 	.axis_relative_direction = handle_ptr_axis_relative_direction
 };
 
+/**
+ *   Keyboard input.
+ *
+ * Keymaps, compose and the keycode tables are shared with the X11 backend
+ * (see unix/xkb.cc). Platform keycodes are XKB keycodes, which are the evdev
+ * codes that wl_keyboard sends plus 8.
+ *
+ * The keymap is mapped read-only straight from the fd that the compositor
+ * sends, and xkbcommon parses it in place.
+ *
+ * Wayland leaves key repeat to the client. The compositor tells us the rate
+ * and delay, and we run a timerfd that is in the wait set: when it expires,
+ * vkfwWlDispatchKeyRepeat generates the repeated key presses from the event
+ * pump. This way, repeat does not need a thread or a busy loop.
+ */
+static bool has_xkb;
+static VKFWxkbkeyboard keyboard;
+
+static int repeat_fd = -1;
+static int32_t repeat_rate = 25, repeat_delay = 600;
+static uint32_t repeat_keycode;
+
+/**
+ * If the application stalls, don't flood it with repeats when it wakes up.
+ */
+#define VKFW_WL_MAX_REPEATS 8
+
+static void
+set_repeat_timer (int32_t delay, int32_t rate)
+{
+	struct itimerspec its {};
+	if (delay) {
+		long interval = 1000000000L / rate;
+		its.it_value.tv_sec = delay / 1000;
+		its.it_value.tv_nsec = (delay % 1000) * 1000000L;
+		its.it_interval.tv_sec = interval / 1000000000L;
+		its.it_interval.tv_nsec = interval % 1000000000L;
+	}
+
+	timerfd_settime (repeat_fd, 0, &its, nullptr);
+}
+
+static void
+stop_repeat (void)
+{
+	if (repeat_keycode) {
+		repeat_keycode = 0;
+		set_repeat_timer (0, 0);
+	}
+}
+
+static const unsigned int key_press_mask = VKFW_EVENT_BIT (VKFW_EVENT_KEY_PRESSED)
+	| VKFW_EVENT_BIT (VKFW_EVENT_TEXT_INPUT);
+
+static void
+send_key_event (uint32_t type, uint32_t keycode)
+{
+	unsigned int mask = VKFW_EVENT_BIT (type);
+	if (type == VKFW_EVENT_KEY_PRESSED)
+		mask = key_press_mask;
+	if (!window_wants (kbd_focus_window, mask))
+		return;
+
+	VKFWevent e {};
+	e.type = type;
+	e.window = (VKFWwindow *) kbd_focus_window;
+	e.keycode = keycode;
+	e.modifiers = vkfwXkbGetModifiers (&keyboard);
+	if (ptr_focus_window == kbd_focus_window) {
+		e.x = ptr_x;
+		e.y = ptr_y;
+	}
+
+	if (type == VKFW_EVENT_KEY_PRESSED)
+		vkfwXkbKeyPress (&keyboard, &e);
+	vkfwSendEventToApplication (&e);
+}
+
+void
+vkfwWlDispatchKeyRepeat (void)
+{
+	uint64_t count;
+	if (repeat_fd == -1 || read (repeat_fd, &count, sizeof (count)) != sizeof (count))
+		return;
+
+	if (!repeat_keycode || !kbd_focus_window)
+		return;
+
+	if (count > VKFW_WL_MAX_REPEATS)
+		count = VKFW_WL_MAX_REPEATS;
+	for (uint64_t i = 0; i < count; i++)
+		send_key_event (VKFW_EVENT_KEY_PRESSED, repeat_keycode);
+}
+
+int
+vkfwWlGetKeyRepeatFd (void)
+{
+	return repeat_fd;
+}
+
 static void
 handle_kbd_keymap (void *data, wl_keyboard *dev, uint32_t format,
 	int32_t fd_, uint32_t size)
 {
 	int fd = fd_;
 
+	if (format != WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1 || !vkfw_xkb_ctx) {
+		close (fd);
+		return;
+	}
+
+	/**
+	 * Since wl_seat version 7, the fd must be mapped with MAP_PRIVATE. The
+	 * mapping stays valid after the fd is closed.
+	 */
+	char *map = (char *) mmap (nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
 	close (fd);
+	if (map == MAP_FAILED) {
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: failed to map keymap\n");
+		return;
+	}
+
+	/**
+	 * The keymap is NUL-terminated, and size includes the terminator.
+	 */
+	xkb_keymap *keymap = xkb_keymap_new_from_buffer (vkfw_xkb_ctx, map,
+		strnlen (map, size), XKB_KEYMAP_FORMAT_TEXT_V1,
+		XKB_KEYMAP_COMPILE_NO_FLAGS);
+	munmap (map, size);
+	if (!keymap) {
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: failed to compile keymap\n");
+		return;
+	}
+
+	xkb_state *state = xkb_state_new (keymap);
+	if (!state) {
+		xkb_keymap_unref (keymap);
+		return;
+	}
+
+	stop_repeat ();
+	if (!vkfwXkbSetKeymap (&keyboard, keymap, state, 0, 255))
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: failed to setup keyboard state\n");
 }
 
 static void
 handle_kbd_enter (void *data, wl_keyboard *dev, uint32_t serial,
 	wl_surface *surface, wl_array *keys)
 {
+	kbd_defocus ();
+
+	kbd_focus_window = (VKFWwlwindow *) wl_surface_get_user_data (surface);
+	if (kbd_focus_window) {
+		vkfwRefWindow ((VKFWwindow *) kbd_focus_window);
+		kbd_focus = surface;
 
+		VKFWevent e {};
+		e.type = VKFW_EVENT_WINDOW_GAINED_FOCUS;
+		e.window = (VKFWwindow *) kbd_focus_window;
+		vkfwSendEventToApplication (&e);
+	}
 }
 
 static void
@@ -263,7 +535,25 @@ static void
 handle_kbd_key (void *data, wl_keyboard *dev, uint32_t serial,
 	uint32_t key, uint32_t time, uint32_t state)
 {
+	if (!kbd_focus_window)
+		return;
 
+	uint32_t keycode = key + 8;
+	if (state == WL_KEYBOARD_KEY_STATE_PRESSED) {
+		send_key_event (VKFW_EVENT_KEY_PRESSED, keycode);
+
+		if (keyboard.keymap && repeat_rate > 0
+			&& window_wants (kbd_focus_window, key_press_mask)
+			&& xkb_keymap_key_repeats (keyboard.keymap, keycode)) {
+			repeat_keycode = keycode;
+			set_repeat_timer (repeat_delay ? repeat_delay : 1, repeat_rate);
+		}
+	} else {
+		if (keycode == repeat_keycode)
+			stop_repeat ();
+
+		send_key_event (VKFW_EVENT_KEY_RELEASED, keycode);
+	}
 }
 
 static void
@@ -271,14 +561,19 @@ handle_kbd_modifiers (void *data, wl_keyboard *dev, uint32_t serial,
 	uint32_t mods_depressed, uint32_t mods_latched, uint32_t mods_locked,
 	uint32_t group)
 {
-
+	if (keyboard.state)
+		xkb_state_update_mask (keyboard.state, mods_depressed,
+			mods_latched, mods_locked, 0, 0, group);
 }
 
 static void
 handle_kbd_repeat_info (void *data, wl_keyboard *dev, int32_t rate,
 	int32_t delay)
 {
-
+	repeat_rate = rate;
+	repeat_delay = delay;
+	if (rate <= 0)
+		stop_repeat ();
 }
 
 static const struct wl_keyboard_listener keyboard_listener = {
@@ -299,13 +594,15 @@ handle_wl_seat_capabilites (void *data, wl_seat *seat, uint32_t cap)
 	if (cap & WL_SEAT_CAPABILITY_POINTER) {
 		if (!ptr_dev) {
 			ptr_dev = wl_seat_get_pointer (seat);
-			if (ptr_dev)
+			if (ptr_dev) {
 				wl_pointer_add_listener (ptr_dev, &pointer_listener, nullptr);
-			else
+				create_relative_pointer ();
+			} else
 				vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: failed to create pointer device\n");
 		}
 	} else {
 		if (ptr_dev) {
+			destroy_relative_pointer ();
 			wl_pointer_destroy (ptr_dev);
 			ptr_dev = nullptr;
 
@@ -360,14 +657,36 @@ vkfwWlInitializeInput (uint32_t seat_id)
 	wl_surface_attach (cursor_surface, vkfwWlCursorBuffer, 0, 0);
 	wl_surface_commit (cursor_surface);
 
+	repeat_fd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (repeat_fd == -1) {
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: timerfd_create failed with errno %d\n", errno);
+		wl_surface_destroy (cursor_surface);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	if (vkfwCurrentPlatform->addWaitFd (repeat_fd, VKFW_FD_READABLE,
+		nullptr, nullptr) != VK_SUCCESS) {
+		close (repeat_fd);
+		repeat_fd = -1;
+		wl_surface_destroy (cursor_surface);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
 	seat = (wl_seat *) wl_registry_bind (vkfwWlRegistry, seat_id, &wl_seat_interface, 7);
 	if (!seat) {
+		vkfwCurrentPlatform->removeWaitFd (repeat_fd);
+		close (repeat_fd);
+		repeat_fd = -1;
 		wl_surface_destroy (cursor_surface);
 		return VK_ERROR_INITIALIZATION_FAILED;
 	}
 
+	has_xkb = vkfwXkbInit ("Wayland");
+	if (!has_xkb)
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Wayland: Failed to initialize XKB. Keyboard input will probably be broken\n");
+
 	wl_seat_add_listener (seat, &seat_listener, nullptr);
-	wl_display_roundtrip (vkfwWlDisplay);
+	wl_display_roundtrip_queue (vkfwWlDisplay, vkfwWlQueue);
 
 	return VK_SUCCESS;
 }
@@ -376,6 +695,7 @@ void
 vkfwWlTerminateInput (void)
 {
 	if (ptr_dev) {
+		destroy_relative_pointer ();
 		wl_pointer_destroy (ptr_dev);
 		ptr_defocus ();
 	}
@@ -384,4 +704,84 @@ vkfwWlTerminateInput (void)
 		kbd_defocus ();
 	}
 	wl_seat_destroy (seat);
+
+	if (has_xkb) {
+		vkfwXkbReleaseKeyboard (&keyboard);
+		vkfwXkbTerminate ();
+		has_xkb = false;
+	}
+
+	vkfwCurrentPlatform->removeWaitFd (repeat_fd);
+	close (repeat_fd);
+	repeat_fd = -1;
+}
+
+/**
+ *   Pointer constraints.
+ *
+ * VKFW_POINTER_RELATIVE locks the pointer in place, as the application only
+ * cares about the motion. Otherwise, VKFW_POINTER_CONFINED confines the
+ * pointer to the content surface. Wayland has no equivalent to an X11
+ * pointer grab, so VKFW_POINTER_GRABBED on its own does nothing.
+ *
+ * Constraints are persistent: the compositor deactivates them when the
+ * window loses focus and reactivates them when it regains focus.
+ *
+ * note: constraints are created for the current wl_pointer. If the seat
+ * loses its pointer and gains a new one, they are not recreated until the
+ * pointer mode of the window changes.
+ */
+static void
+destroy_constraints (VKFWwlwindow *w)
+{
+	if (w->locked_pointer) {
+		zwp_locked_pointer_v1_destroy (w->locked_pointer);
+		w->locked_pointer = nullptr;
+	}
+	if (w->confined_pointer) {
+		zwp_confined_pointer_v1_destroy (w->confined_pointer);
+		w->confined_pointer = nullptr;
+	}
+}
+
+void
+vkfwWlUpdatePointerMode (VKFWwindow *window)
+{
+	VKFWwlwindow *w = (VKFWwlwindow *) window;
+	std::scoped_lock g (vkfw_input_mu);
+	uint32_t f = window->pointer_flags.load (std::memory_order_relaxed);
+	uint32_t m = w->pointer_mode;
+	w->pointer_mode = f;
+
+	uint32_t constraint_mask = VKFW_POINTER_RELATIVE | VKFW_POINTER_CONFINED;
+	if ((f & constraint_mask) != (m & constraint_mask)) {
+		destroy_constraints (w);
+
+		if (vkfwZwpPointerConstraintsV1 && ptr_dev) {
+			if (f & VKFW_POINTER_RELATIVE)
+				w->locked_pointer = zwp_pointer_constraints_v1_lock_pointer (
+					vkfwZwpPointerConstraintsV1, w->content_surface, ptr_dev,
+					nullptr, ZWP_POINTER_CONSTRAINTS_V1_LIFETIME_PERSISTENT);
+			else if (f & VKFW_POINTER_CONFINED)
+				w->confined_pointer = zwp_pointer_constraints_v1_confine_pointer (
+					vkfwZwpPointerConstraintsV1, w->content_surface, ptr_dev,
+					nullptr, ZWP_POINTER_CONSTRAINTS_V1_LIFETIME_PERSISTENT);
+		}
+	}
+
+	if ((f & VKFW_POINTER_RELATIVE) && !(m & VKFW_POINTER_RELATIVE) && w == ptr_focus_window) {
+		rel_x = 0;
+		rel_y = 0;
+	}
+
+	if (ptr_dev && w == ptr_focus_window)
+		update_cursor ();
+
+	wl_display_flush (vkfwWlDisplay);
+}
+
+void
+vkfwWlReleasePointer (VKFWwlwindow *w)
+{
+	destroy_constraints (w);
 }
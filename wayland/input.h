@@ -4,8 +4,31 @@
  */
 #include <VKFW/vkfw.h>
 
+typedef struct VKFWwlwindow_T VKFWwlwindow;
+
 VkResult
 vkfwWlInitializeInput (uint32_t seat_id);
 
 void
 vkfwWlTerminateInput (void);
+
+/**
+ * Destroy the pointer lock or confinement of a window that is about to be
+ * destroyed.
+ */
+void
+vkfwWlReleasePointer (VKFWwlwindow *w);
+
+/**
+ * Generate repeated key presses if the key repeat timer has expired. This is
+ * called from the event pump.
+ */
+void
+vkfwWlDispatchKeyRepeat (void);
+
+/**
+ * The key repeat timerfd. It is in the wait set, except when the input thread
+ * is running; then vkfwWlWaitInput polls it.
+ */
+int
+vkfwWlGetKeyRepeatFd (void);
@@ -7,18 +7,39 @@
 
 #include "wayland_functions.h"
 #include "wayland-protocol.h"
+#include "presentation-time-protocol.h"
 #include "viewporter-protocol.h"
 #include "xdg-shell-protocol.h"
+#include "zwp-pointer-constraints-v1-protocol.h"
+#include "zwp-relative-pointer-v1-protocol.h"
 #include "zxdg-decoration-v1-protocol.h"
+#include <time.h>
 
 extern wl_display *vkfwWlDisplay;
+
+/**
+ * All VKFW proxies live on vkfwWlQueue rather than on the default queue, so
+ * that we never dispatch events that belong to the Vulkan WSI (or anyone
+ * else sharing the connection), and they never dispatch ours. Objects
+ * inherit the queue of the proxy that created them, so it is enough to
+ * create the registry on vkfwWlQueue.
+ */
+extern wl_event_queue *vkfwWlQueue;
 extern wl_registry *vkfwWlRegistry;
 extern wl_compositor *vkfwWlCompositor;
 extern wl_subcompositor *vkfwWlSubcompositor;
 extern wl_shm *vkfwWlShm;
 extern wp_viewporter *vkfwWpViewporter;
+extern wp_presentation *vkfwWpPresentation;
+
+/**
+ * The clock of the timestamps in wp_presentation_feedback.presented.
+ */
+extern clockid_t vkfwWpPresentationClock;
 extern xdg_wm_base *vkfwXdgWmBase;
 extern zxdg_decoration_manager_v1 *vkfwZxdgDecorationManagerV1;
+extern zwp_relative_pointer_manager_v1 *vkfwZwpRelativePointerManagerV1;
+extern zwp_pointer_constraints_v1 *vkfwZwpPointerConstraintsV1;
 
 extern bool vkfwWlSupportCSD;
 
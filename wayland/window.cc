@@ -6,9 +6,11 @@
 #include <VKFW/logging.h>
 #include <VKFW/vkfw.h>
 #include <VKFW/window.h>
+#include "input.h"
 #include "wayland.h"
 #include "window.h"
 
+#include <mutex>
 #include <stdlib.h>
 #include <string.h>
 
@@ -123,11 +125,29 @@ handle_toplevel_configure (void *window, xdg_toplevel *toplevel,
 	int32_t width, int32_t height, wl_array *states)
 {
 	(void) toplevel;
-	(void) states;
 
 	VKFWwlwindow *w = (VKFWwlwindow *) window;
 	if (width)	w->configured_width = width;
 	if (height)	w->configured_height = height;
+
+	/**
+	 * xdg_toplevel has no minimized state; compositors that stop
+	 * repainting a window, for whatever reason, say so with the
+	 * suspended state (xdg_wm_base version 6).
+	 */
+	w->suspended = false;
+	uint32_t *state;
+	wl_array_for_each (state, states) {
+		if (*state == XDG_TOPLEVEL_STATE_SUSPENDED)
+			w->suspended = true;
+	}
+
+	VKFWevent e {};
+	e.type = vkfwUpdateWindowVisibility ((VKFWwindow *) w,
+		w->suspended ? VKFW_VISIBILITY_SUSPENDED : VKFW_VISIBILITY_VISIBLE);
+	e.window = (VKFWwindow *) w;
+	if (e.type != VKFW_EVENT_NULL)
+		vkfwSendEventToApplication (&e);
 }
 
 static void
@@ -196,9 +216,11 @@ vkfwWlCreateWindow (VKFWwindow *window)
 	w->xdg_toplevel = nullptr;
 	w->decoration_v1 = nullptr;
 
-	w->configured_width = window->extent.width;
-	w->configured_height = window->extent.height;
+	VkExtent2D extent = window->extent.load (std::memory_order_relaxed);
+	w->configured_width = extent.width;
+	w->configured_height = extent.height;
 	w->visible = false;
+	w->suspended = false;
 	w->use_csd = vkfwWlSupportCSD;
 	w->has_csd = false;
 	w->has_csd_buffer_attached = false;
@@ -206,6 +228,13 @@ vkfwWlCreateWindow (VKFWwindow *window)
 
 	w->title = nullptr;
 
+	w->pointer_mode = 0;
+	w->locked_pointer = nullptr;
+	w->confined_pointer = nullptr;
+	w->frame_callback = nullptr;
+	for (int i = 0; i < VKFW_WL_MAX_PRESENTATION_FEEDBACK; i++)
+		w->presentation_feedback[i] = nullptr;
+
 	w->content_surface = wl_compositor_create_surface (vkfwWlCompositor);
 	if (!w->content_surface)
 		return VK_ERROR_INITIALIZATION_FAILED;
@@ -263,6 +292,16 @@ vkfwWlDestroyWindow (VKFWwindow *window)
 {
 	VKFWwlwindow *w = (VKFWwlwindow *) window;
 
+	vkfwWlReleasePointer (w);
+
+	if (w->frame_callback)
+		wl_callback_destroy (w->frame_callback);
+
+	for (int i = 0; i < VKFW_WL_MAX_PRESENTATION_FEEDBACK; i++) {
+		if (w->presentation_feedback[i])
+			wp_presentation_feedback_destroy (w->presentation_feedback[i]);
+	}
+
 	if (w->has_csd_decorations)
 		destroy_csd_decorations (w);
 
@@ -290,10 +329,15 @@ vkfwWlDestroyWindow (VKFWwindow *window)
 		free (w->title);
 }
 
+/**
+ * The window functions below change proxies and window state that listeners
+ * use as well, so they take the input lock.
+ */
 VkResult
 vkfwWlShowWindow (VKFWwindow *window)
 {
 	VKFWwlwindow *w = (VKFWwlwindow *) window;
+	std::scoped_lock g (vkfw_input_mu);
 
 	if (w->visible)
 		return VK_SUCCESS;
@@ -343,7 +387,7 @@ vkfwWlShowWindow (VKFWwindow *window)
 	wl_surface_commit (w->content_surface);
 	if (vkfwWlSupportCSD)
 			wl_surface_commit (w->frame_surface);
-	wl_display_roundtrip (vkfwWlDisplay);
+	wl_display_roundtrip_queue (vkfwWlDisplay, vkfwWlQueue);
 	return VK_SUCCESS;
 }
 
@@ -351,10 +395,20 @@ VkResult
 vkfwWlHideWindow (VKFWwindow *window)
 {
 	VKFWwlwindow *w = (VKFWwlwindow *) window;
+	std::scoped_lock g (vkfw_input_mu);
 
 	if (!w->visible)
 		return VK_SUCCESS;
 
+	/**
+	 * An unmapped surface is never repainted, so a pending callback would
+	 * never fire.
+	 */
+	if (w->frame_callback) {
+		wl_callback_destroy (w->frame_callback);
+		w->frame_callback = nullptr;
+	}
+
 	if (w->decoration_v1) {
 		zxdg_toplevel_decoration_v1_destroy (w->decoration_v1);
 		w->decoration_v1 = nullptr;
@@ -381,7 +435,164 @@ vkfwWlHideWindow (VKFWwindow *window)
 		wl_surface_commit (w->content_surface);
 
 	w->visible = false;
+	w->suspended = false;
 	wl_display_flush (vkfwWlDisplay);
+
+	/**
+	 * Nothing from the compositor tells us about this, so send the event
+	 * ourselves.
+	 */
+	VKFWevent e {};
+	e.type = vkfwUpdateWindowVisibility (window, VKFW_VISIBILITY_HIDDEN);
+	e.window = window;
+	if (e.type != VKFW_EVENT_NULL)
+		vkfwSendEventToApplication (&e);
+	return VK_SUCCESS;
+}
+
+static void
+handle_frame_done (void *window, wl_callback *callback, uint32_t time)
+{
+	(void) time;
+
+	VKFWwlwindow *w = (VKFWwlwindow *) window;
+	wl_callback_destroy (callback);
+	w->frame_callback = nullptr;
+
+	VKFWevent e {};
+	e.type = VKFW_EVENT_FRAME_READY;
+	e.window = (VKFWwindow *) w;
+	vkfwSendEventToApplication (&e);
+}
+
+static const struct wl_callback_listener frame_listener = {
+	.done = handle_frame_done
+};
+
+/**
+ * The frame request is only sent to the compositor with the next commit of
+ * content_surface, which the Vulkan WSI makes when the application presents.
+ * We don't commit here, as that could race with a commit by the WSI on
+ * another thread.
+ */
+VkResult
+vkfwWlRequestFrame (VKFWwindow *window)
+{
+	VKFWwlwindow *w = (VKFWwlwindow *) window;
+	std::scoped_lock g (vkfw_input_mu);
+
+	if (w->frame_callback)
+		return VK_SUCCESS;
+
+	w->frame_callback = wl_surface_frame (w->content_surface);
+	if (!w->frame_callback)
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+
+	wl_callback_add_listener (w->frame_callback, &frame_listener, w);
+	return VK_SUCCESS;
+}
+
+/**
+ * Convert a timestamp on vkfwWpPresentationClock to the vkfwGetTime
+ * timebase, by how long ago it was on the presentation clock. In practice
+ * both are CLOCK_MONOTONIC, but the compositor is free to pick another clock.
+ */
+static uint64_t
+presentation_time (uint64_t sec, uint32_t nsec)
+{
+	struct timespec now;
+	if (clock_gettime (vkfwWpPresentationClock, &now))
+		return vkfwGetTime ();
+
+	int64_t age = ((int64_t) now.tv_sec - (int64_t) sec) * 1000000
+		+ ((int64_t) now.tv_nsec - (int64_t) nsec) / 1000;
+	return vkfwGetTime () - age;
+}
+
+static void
+release_presentation_feedback (VKFWwlwindow *w, struct wp_presentation_feedback *feedback)
+{
+	for (int i = 0; i < VKFW_WL_MAX_PRESENTATION_FEEDBACK; i++) {
+		if (w->presentation_feedback[i] == feedback)
+			w->presentation_feedback[i] = nullptr;
+	}
+
+	wp_presentation_feedback_destroy (feedback);
+}
+
+static void
+handle_presentation_sync_output (void *window, struct wp_presentation_feedback *feedback,
+	wl_output *output)
+{
+	(void) window;
+	(void) feedback;
+	(void) output;
+}
+
+static void
+handle_presentation_presented (void *window, struct wp_presentation_feedback *feedback,
+	uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec, uint32_t refresh,
+	uint32_t seq_hi, uint32_t seq_lo, uint32_t flags)
+{
+	VKFWwlwindow *w = (VKFWwlwindow *) window;
+	release_presentation_feedback (w, feedback);
+
+	/**
+	 * The VKFW_PRESENT_* bits have the same values as the protocol's kind
+	 * bits.
+	 */
+	VKFWpresentfeedback f {};
+	f.presented = true;
+	f.flags = flags & (VKFW_PRESENT_VSYNC | VKFW_PRESENT_HW_CLOCK
+		| VKFW_PRESENT_HW_COMPLETION | VKFW_PRESENT_ZERO_COPY);
+	f.time = presentation_time (((uint64_t) tv_sec_hi << 32) | tv_sec_lo, tv_nsec);
+	f.refresh = refresh / 1000;
+	f.sequence = ((uint64_t) seq_hi << 32) | seq_lo;
+	vkfwSendPresentationFeedback ((VKFWwindow *) w, &f);
+}
+
+static void
+handle_presentation_discarded (void *window, struct wp_presentation_feedback *feedback)
+{
+	VKFWwlwindow *w = (VKFWwlwindow *) window;
+	release_presentation_feedback (w, feedback);
+
+	VKFWpresentfeedback f {};
+	vkfwSendPresentationFeedback ((VKFWwindow *) w, &f);
+}
+
+static const struct wp_presentation_feedback_listener presentation_feedback_listener = {
+	.sync_output = handle_presentation_sync_output,
+	.presented = handle_presentation_presented,
+	.discarded = handle_presentation_discarded
+};
+
+/**
+ * Like the frame callback, the feedback belongs to the next commit of
+ * content_surface by the Vulkan WSI.
+ */
+VkResult
+vkfwWlRequestPresentationFeedback (VKFWwindow *window)
+{
+	VKFWwlwindow *w = (VKFWwlwindow *) window;
+	std::scoped_lock g (vkfw_input_mu);
+
+	if (!vkfwWpPresentation)
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+
+	int slot = 0;
+	while (w->presentation_feedback[slot]) {
+		if (++slot == VKFW_WL_MAX_PRESENTATION_FEEDBACK)
+			return VK_NOT_READY;
+	}
+
+	struct wp_presentation_feedback *feedback = wp_presentation_feedback (
+		vkfwWpPresentation, w->content_surface);
+	if (!feedback)
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+
+	wp_presentation_feedback_add_listener (feedback, &presentation_feedback_listener, w);
+	w->presentation_feedback[slot] = feedback;
 	return VK_SUCCESS;
 }
 
@@ -394,6 +605,7 @@ vkfwWlSetWindowTitle (VKFWwindow *window, const char *title)
 	if (!s)
 		return VK_ERROR_OUT_OF_HOST_MEMORY;
 
+	std::scoped_lock g (vkfw_input_mu);
 	if (w->title)
 		free (w->title);
 	w->title = s;
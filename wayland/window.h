@@ -7,6 +7,8 @@
 
 typedef struct VKFWwlwindow_T VKFWwlwindow;
 
+#define VKFW_WL_MAX_PRESENTATION_FEEDBACK 8
+
 struct VKFWwlwindow_T {
 	VKFWwindow window;
 	wl_surface *content_surface;
@@ -26,12 +28,28 @@ struct VKFWwlwindow_T {
 	wl_subsurface *close_button_subsurface;
 
 	bool visible;
+	bool suspended;
 	bool use_csd;
 	bool has_csd;
 	bool has_csd_buffer_attached;
 	bool has_csd_decorations;
 
 	char *title;
+
+	uint32_t pointer_mode;
+	zwp_locked_pointer_v1 *locked_pointer;
+	zwp_confined_pointer_v1 *confined_pointer;
+
+	/**
+	 * Pending wl_surface.frame callback on content_surface.
+	 */
+	wl_callback *frame_callback;
+
+	/**
+	 * Pending wp_presentation_feedback objects on content_surface. Free
+	 * slots are nullptr.
+	 */
+	struct wp_presentation_feedback *presentation_feedback[VKFW_WL_MAX_PRESENTATION_FEEDBACK];
 };
 
 VkResult
@@ -48,3 +66,12 @@ vkfwWlHideWindow (VKFWwindow *window);
 
 VkResult
 vkfwWlSetWindowTitle (VKFWwindow *window, const char *title);
+
+void
+vkfwWlUpdatePointerMode (VKFWwindow *window);
+
+VkResult
+vkfwWlRequestFrame (VKFWwindow *window);
+
+VkResult
+vkfwWlRequestPresentationFeedback (VKFWwindow *window);
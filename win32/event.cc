@@ -2,6 +2,7 @@
  * Win32 event handling.
  * Copyright (C) 2024  dbstream
  */
+#include <VKFW/event.h>
 #include <VKFW/logging.h>
 #include <VKFW/vector.h>
 #include <VKFW/vkfw.h>
@@ -34,6 +35,16 @@ static int current_mode;
 static uint64_t current_timeout;
 static VkResult current_result;
 
+/**
+ * Empty events from vkfwPostEmptyEvent are reported as VKFW_EVENT_NONE, so
+ * that the caller treats them as the end of a batch and stops waiting.
+ */
+static bool
+is_empty_event (const MSG *msg)
+{
+	return !msg->hwnd && msg->message == WM_NULL;
+}
+
 static void WINAPI
 event_loop (LPVOID fiber_parameter)
 {
@@ -50,7 +61,7 @@ event_loop (LPVOID fiber_parameter)
 
 		if (b) {
 			DispatchMessageW (&msg);
-			if (current_event->type == VKFW_EVENT_NONE)
+			if (current_event->type == VKFW_EVENT_NONE && !is_empty_event (&msg))
 				current_event->type = VKFW_EVENT_NULL;
 			continue;
 		}
@@ -75,7 +86,7 @@ event_loop (LPVOID fiber_parameter)
 
 		if (b) {
 			DispatchMessageW (&msg);
-			if (current_event->type == VKFW_EVENT_NONE)
+			if (current_event->type == VKFW_EVENT_NONE && !is_empty_event (&msg))
 				current_event->type = VKFW_EVENT_NULL;
 		}
 	}
@@ -140,10 +151,34 @@ vkfwWin32WndProc (HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
 		current_event->type = VKFW_EVENT_WINDOW_CLOSE_REQUEST;
 		SwitchToFiber (main_fiber);
 		return 0;
+	case WM_SHOWWINDOW:
+		current_event->type = vkfwUpdateWindowVisibility ((VKFWwindow *) w,
+			wparam ? VKFW_VISIBILITY_VISIBLE : VKFW_VISIBILITY_HIDDEN);
+		SwitchToFiber (main_fiber);
+		return 0;
 	case WM_SIZE:
+		/**
+		 * A minimized window has an extent of 0x0, which is of no use
+		 * to the application.
+		 */
+		if (wparam == SIZE_MINIMIZED) {
+			current_event->type = vkfwUpdateWindowVisibility (
+				(VKFWwindow *) w, VKFW_VISIBILITY_SUSPENDED);
+			SwitchToFiber (main_fiber);
+			return 0;
+		}
+
 		current_event->type = VKFW_EVENT_WINDOW_RESIZE_NOTIFY;
 		current_event->extent.width = LOWORD (lparam);
 		current_event->extent.height = HIWORD (lparam);
+		{
+			VKFWevent e {};
+			e.type = vkfwUpdateWindowVisibility ((VKFWwindow *) w,
+				VKFW_VISIBILITY_VISIBLE);
+			e.window = (VKFWwindow *) w;
+			if (e.type != VKFW_EVENT_NULL)
+				vkfwQueueEvent (&e);
+		}
 		SwitchToFiber (main_fiber);
 		return 0;
 	default:
@@ -106,6 +106,39 @@ delayWin32 (uint64_t t)
 	Sleep (t / 1000);
 }
 
+/**
+ * Posted thread messages wake up MsgWaitForMultipleObjects in the event
+ * fiber. They are dispatched to no window, so the event loop just returns
+ * VKFW_EVENT_NULL.
+ */
+static DWORD event_thread_id;
+
+static void
+postEmptyEventWin32 (void)
+{
+	PostThreadMessageW (event_thread_id, WM_NULL, 0, 0);
+}
+
+/**
+ * Wait until there is a message in the queue, which includes the WM_NULL
+ * from postEmptyEventWin32. The message is left for the event fiber to
+ * dispatch. MWMO_INPUTAVAILABLE makes this return for messages that an
+ * earlier PeekMessageW has already seen.
+ */
+static void
+waitUntilWin32 (uint64_t deadline)
+{
+	DWORD timeout = INFINITE;
+	if (deadline != UINT64_MAX) {
+		uint64_t now = getTimeWin32 ();
+		uint64_t ms = deadline > now ? (deadline - now + 999) / 1000 : 0;
+		timeout = ms < INFINITE ? (DWORD) ms : INFINITE - 1;
+	}
+
+	MsgWaitForMultipleObjectsEx (0, nullptr, timeout, QS_ALLINPUT,
+		MWMO_INPUTAVAILABLE);
+}
+
 /**
  * GCC allows struct declarations like
  *   VKFWplatform platform = {
@@ -131,6 +164,10 @@ initPlatformWin32 (void)
 	vkfwPlatformWin32.lookupSymbol = lookupSymbolWin32;
 	vkfwPlatformWin32.getTime = getTimeWin32;
 	vkfwPlatformWin32.delay = delayWin32;
+	vkfwPlatformWin32.waitUntil = waitUntilWin32;
+	vkfwPlatformWin32.postEmptyEvent = postEmptyEventWin32;
+
+	event_thread_id = GetCurrentThreadId ();
 
 	/** 
 	 * This will actually initialize vkfwHInstance to the application
@@ -4,6 +4,7 @@
  */
 #define VK_USE_PLATFORM_WIN32_KHR
 
+#include <VKFW/event.h>
 #include <VKFW/logging.h>
 #include <VKFW/vkfw.h>
 #include <VKFW/window.h>
@@ -65,12 +66,30 @@ vkfwWin32CreateWindowSurface (VKFWwindow *handle, VkSurfaceKHR *out)
 	return vkCreateWin32SurfaceKHR (vkfwLoadedInstance, &ci, nullptr, out);
 }
 
+/**
+ * ShowWindow sends WM_SHOWWINDOW and WM_SIZE on the main fiber, where our
+ * WndProc passes them straight to DefWindowProcW, so send the visibility
+ * event ourselves.
+ */
+static void
+send_visibility_event (VKFWwindow *handle, int visibility)
+{
+	std::scoped_lock g (vkfw_input_mu);
+
+	VKFWevent e {};
+	e.type = vkfwUpdateWindowVisibility (handle, visibility);
+	e.window = handle;
+	if (e.type != VKFW_EVENT_NULL)
+		vkfwSendEventToApplication (&e);
+}
+
 VkResult
 vkfwWin32ShowWindow (VKFWwindow *handle)
 {
 	VKFWwin32window *w = (VKFWwin32window *) handle;
 
 	ShowWindow (w->hwnd, SW_SHOWNORMAL);
+	send_visibility_event (handle, VKFW_VISIBILITY_VISIBLE);
 	return VK_SUCCESS;
 }
 
@@ -80,6 +99,7 @@ vkfwWin32HideWindow (VKFWwindow *handle)
 	VKFWwin32window *w = (VKFWwin32window *) handle;
 
 	ShowWindow (w->hwnd, SW_HIDE);
+	send_visibility_event (handle, VKFW_VISIBILITY_HIDDEN);
 	return VK_SUCCESS;
 }
 
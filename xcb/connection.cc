@@ -8,24 +8,23 @@
 #include <VKFW/platform.h>
 #include <VKFW/vkfw.h>
 #include <VKFW/window_api.h>
+#include <VKFW/xkb.h>
 #include <xcb/xcb.h>
 #include <vulkan/vulkan_xcb.h>
 #include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
+#include <mutex>
 #include "event.h"
 #include "keyboard.h"
+#include "pointer.h"
 #include "window.h"
+#include "wm_sync.h"
 #include "xcb.h"
 
-bool
-vkfwXcbCheck (xcb_void_cookie_t cookie)
+static void
+print_error (xcb_generic_error_t *e)
 {
-	xcb_generic_error_t *e = xcb_request_check (vkfw_xcb_connection, cookie);
-
-	if (!e)
-		return false;
-
 	vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: error %u (conn_error=%d)\n",
 		e->error_code, xcb_connection_has_error (vkfw_xcb_connection));
 
@@ -36,11 +35,186 @@ vkfwXcbCheck (xcb_void_cookie_t cookie)
 		xcb_value_error_t *ve = (xcb_value_error_t *) e;
 		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: ... bad value=%u\n", ve->bad_value);
 	}
+}
 
+bool
+vkfwXcbCheck (xcb_void_cookie_t cookie)
+{
+	xcb_generic_error_t *e = xcb_request_check (vkfw_xcb_connection, cookie);
+
+	if (!e)
+		return false;
+
+	print_error (e);
 	free (e);
 	return true;
 }
 
+/**
+ *   Asynchronous error handling.
+ *
+ * xcb_request_check is a round trip to the X server, so outside of
+ * initialization, requests are sent unchecked. Errors for unchecked requests
+ * arrive in the event stream. vkfwXcbTrackRequest remembers what a request
+ * was for, so that vkfwXcbHandleError can report the error with some context
+ * and record it in the window that the request was made for.
+ *
+ * Tracked requests are retired as soon as an event with a later sequence
+ * number arrives, as the server handles requests in order. If the ring is
+ * full, the oldest request is forgotten; its errors are still logged.
+ *
+ * Requests with a reply are tracked separately. xcb_poll_for_reply only looks
+ * at replies that libxcb has already read, so vkfwXcbPollReplies can be called
+ * for every event without waiting for the server. Replies arrive in the order
+ * of the requests, so the first one that isn't there yet ends the search.
+ *
+ * Window functions make requests on any thread, so tracked requests are
+ * protected by their own lock, track_mu. Tracked replies are only used while
+ * translating events and while destroying windows, and are protected by the
+ * input lock.
+ */
+struct tracked_request {
+	uint32_t sequence;
+	const char *what;
+	VKFWxcbwindow *window;
+};
+
+static constexpr uint32_t MAX_TRACKED_REQUESTS = 64;
+
+static std::mutex track_mu;
+static tracked_request tracked_requests[MAX_TRACKED_REQUESTS];
+static uint32_t tracked_head;
+static uint32_t tracked_count;
+
+static bool
+sequence_before (uint32_t a, uint32_t b)
+{
+	return (int32_t) (a - b) < 0;
+}
+
+void
+vkfwXcbTrackRequest (xcb_void_cookie_t cookie, const char *what,
+	VKFWxcbwindow *window)
+{
+	std::scoped_lock g (track_mu);
+	if (tracked_count == MAX_TRACKED_REQUESTS) {
+		tracked_head = (tracked_head + 1) % MAX_TRACKED_REQUESTS;
+		tracked_count--;
+	}
+
+	tracked_request &r = tracked_requests[(tracked_head + tracked_count++) % MAX_TRACKED_REQUESTS];
+	r.sequence = cookie.sequence;
+	r.what = what;
+	r.window = window;
+}
+
+void
+vkfwXcbRetireRequests (uint32_t sequence)
+{
+	std::scoped_lock g (track_mu);
+	while (tracked_count && sequence_before (tracked_requests[tracked_head].sequence, sequence)) {
+		tracked_head = (tracked_head + 1) % MAX_TRACKED_REQUESTS;
+		tracked_count--;
+	}
+}
+
+struct tracked_reply {
+	uint32_t sequence;
+	VKFWxcbwindow *window;
+	VKFWxcbreplyhandler handler;
+};
+
+static constexpr uint32_t MAX_TRACKED_REPLIES = 16;
+
+static tracked_reply tracked_replies[MAX_TRACKED_REPLIES];
+static uint32_t replies_head;
+static uint32_t replies_count;
+
+void
+vkfwXcbTrackReply (uint32_t sequence, VKFWxcbwindow *window,
+	VKFWxcbreplyhandler handler)
+{
+	if (replies_count == MAX_TRACKED_REPLIES) {
+		xcb_discard_reply (vkfw_xcb_connection, tracked_replies[replies_head].sequence);
+		replies_head = (replies_head + 1) % MAX_TRACKED_REPLIES;
+		replies_count--;
+	}
+
+	tracked_reply &r = tracked_replies[(replies_head + replies_count++) % MAX_TRACKED_REPLIES];
+	r.sequence = sequence;
+	r.window = window;
+	r.handler = handler;
+}
+
+void
+vkfwXcbPollReplies (void)
+{
+	while (replies_count) {
+		tracked_reply r = tracked_replies[replies_head];
+
+		void *reply;
+		xcb_generic_error_t *error;
+		if (!xcb_poll_for_reply (vkfw_xcb_connection, r.sequence, &reply, &error))
+			return;
+
+		replies_head = (replies_head + 1) % MAX_TRACKED_REPLIES;
+		replies_count--;
+
+		if (error) {
+			print_error (error);
+			free (error);
+		}
+
+		if (r.window)
+			r.handler (r.window, r.sequence, reply);
+		free (reply);
+	}
+}
+
+void
+vkfwXcbForgetWindowRequests (VKFWxcbwindow *window)
+{
+	{
+		std::scoped_lock g (track_mu);
+		for (uint32_t i = 0; i < tracked_count; i++) {
+			tracked_request &r = tracked_requests[(tracked_head + i) % MAX_TRACKED_REQUESTS];
+			if (r.window == window)
+				r.window = nullptr;
+		}
+	}
+
+	for (uint32_t i = 0; i < replies_count; i++) {
+		tracked_reply &r = tracked_replies[(replies_head + i) % MAX_TRACKED_REPLIES];
+		if (r.window == window)
+			r.window = nullptr;
+	}
+}
+
+void
+vkfwXcbHandleError (xcb_generic_error_t *e)
+{
+	std::scoped_lock g (track_mu);
+	for (uint32_t i = 0; i < tracked_count; i++) {
+		tracked_request &r = tracked_requests[(tracked_head + i) % MAX_TRACKED_REQUESTS];
+		if (r.sequence != e->full_sequence)
+			continue;
+
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: %s failed\n", r.what);
+
+		/**
+		 * Only keep the first error.
+		 */
+		VkResult expected = VK_SUCCESS;
+		if (r.window)
+			r.window->async_result.compare_exchange_strong (expected,
+				(e->error_code == XCB_ALLOC) ? VK_ERROR_OUT_OF_HOST_MEMORY : VK_ERROR_UNKNOWN,
+				std::memory_order_relaxed);
+		break;
+	}
+
+	print_error (e);
+}
+
 static void *libxcb_handle;
 
 static void
@@ -126,15 +300,27 @@ create_cursors (void)
 VKFW_XCB_ALL_ATOMS(VKFW_DECLARE_ATOM)
 #undef VKFW_DECLARE_ATOM
 
-static bool
-load_atoms (void)
+/**
+ * Interning atoms is split in two, so that the replies can come back while
+ * the keyboard is being set up.
+ */
+#define VKFW_DECLARE_ATOM_COOKIE(name) static xcb_intern_atom_cookie_t c_##name;
+VKFW_XCB_ALL_ATOMS(VKFW_DECLARE_ATOM_COOKIE)
+#undef VKFW_DECLARE_ATOM_COOKIE
+
+static void
+intern_atoms (void)
 {
 #define VKFW_INTERN_ATOM(name)					\
-	xcb_intern_atom_cookie_t c_##name = xcb_intern_atom (	\
+	c_##name = xcb_intern_atom (				\
 		vkfw_xcb_connection, 1, strlen(#name), #name);
 VKFW_XCB_ALL_ATOMS(VKFW_INTERN_ATOM)
 #undef VKFW_INTERN_ATOM
+}
 
+static bool
+load_atoms (void)
+{
 	bool failed = false;
 	xcb_intern_atom_reply_t *r;
 	xcb_generic_error_t *e = nullptr;
@@ -183,8 +369,17 @@ vkfwXcbOpen (void)
 
 	vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: using Xcb backend\n");
 
+	/**
+	 * Keymap compilation needs several round-trips to the server. Send
+	 * the InternAtom requests first, so that they are answered during
+	 * those round-trips rather than needing one of their own.
+	 */
+	intern_atoms ();
+	vkfwXcbInitKeyboard ();
+
 	if (!load_atoms ()) {
 		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb backend failed to load atoms\n");
+		vkfwXcbTerminateKeyboard ();
 		xcb_disconnect (vkfw_xcb_connection);
 		unload_xcb_funcs ();
 		return VK_ERROR_INITIALIZATION_FAILED;
@@ -207,19 +402,37 @@ vkfwXcbOpen (void)
 
 	if (!create_cursors ()) {
 		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb backend failed to create cursors\n");
+		vkfwXcbTerminateKeyboard ();
 		xcb_disconnect (vkfw_xcb_connection);
 		unload_xcb_funcs ();
 		return VK_ERROR_INITIALIZATION_FAILED;
 	}
 
-	vkfwXcbInitKeyboard ();
+	VkResult result = vkfwCurrentPlatform->addWaitFd (
+		xcb_get_file_descriptor (vkfw_xcb_connection),
+		VKFW_FD_READABLE, nullptr, nullptr);
+	if (result != VK_SUCCESS) {
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb backend failed to add the connection to the wait set\n");
+		vkfwXcbTerminateKeyboard ();
+		destroy_cursors ();
+		xcb_disconnect (vkfw_xcb_connection);
+		unload_xcb_funcs ();
+		return result;
+	}
+
+	vkfwXcbInitPointer ();
+	vkfwXcbInitSync ();
 	return VK_SUCCESS;
 }
 
 static void
 vkfwXcbClose (void)
 {
+	vkfwCurrentPlatform->removeWaitFd (xcb_get_file_descriptor (vkfw_xcb_connection));
 	vkfwXcbTerminateKeyboard ();
+	vkfwXcbTerminatePointer ();
+	vkfwXcbTerminateSync ();
+	vkfwXcbFreeWindowMap ();
 	destroy_cursors ();
 	xcb_disconnect (vkfw_xcb_connection);
 	unload_xcb_funcs ();
@@ -263,7 +476,20 @@ VKFWwindowbackend vkfwBackendXcb = {
 	.hide_window = vkfwXcbHideWindow,
 	.set_title = vkfwXcbSetWindowTitle,
 	.get_event = vkfwXcbGetEvent,
-	.translate_keycode = vkfwXcbTranslateKeycode,
-	.translate_key = vkfwXcbTranslateKey,
-	.update_pointer_mode = vkfwXcbUpdatePointerMode
+	.translate_keycode = vkfwXkbTranslateKeycode,
+	.translate_key = vkfwXkbTranslateKey,
+	.enable_text_input = vkfwXkbEnableTextInput,
+	.update_pointer_mode = vkfwXcbUpdatePointerMode,
+	.request_frame = vkfwXcbRequestFrame,
+	.update_event_mask = vkfwXcbUpdateEventMask,
+	.ack_resize = vkfwXcbAckResize,
+	.begin_frame = vkfwXcbBeginFrame,
+	.end_frame = vkfwXcbEndFrame,
+	.get_frame_timings = vkfwXcbGetFrameTimings,
+	.dispatch_events = vkfwXcbDispatchEvents,
+	.init_input_thread = vkfwXcbInitInputThread,
+	.wait_input = vkfwXcbWaitInput,
+	.wake_input_thread = vkfwXcbWakeInputThread,
+	.cancel_input_thread = vkfwXcbCancelInputThread,
+	.flush = vkfwXcbFlush
 };
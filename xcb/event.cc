@@ -2,18 +2,26 @@
  * XCB event handling
  * Copyright (C) 2024  dbstream
  */
+#include <VKFW/event.h>
 #include <VKFW/logging.h>
+#include <VKFW/platform.h>
 #include <VKFW/vkfw.h>
 #include <VKFW/window_api.h>
-#include <sys/poll.h>
 #include <inttypes.h>
 #include <stdlib.h>
-#include <errno.h>
 #include "event.h"
 #include "keyboard.h"
+#include "pointer.h"
 #include "window.h"
+#include "wm_sync.h"
 #include "xcb.h"
 
+/**
+ * XI_RawMotion events don't carry modifier state; use the state from the last
+ * core input event instead.
+ */
+static unsigned int last_modifiers;
+
 static void
 set_modifiers (VKFWevent *e, uint16_t state)
 {
@@ -30,11 +38,14 @@ set_modifiers (VKFWevent *e, uint16_t state)
 		e->modifiers |= VKFW_MODIFIER_NUM_LOCK;
 	if (state & XCB_MOD_MASK_3)
 		e->modifiers |= VKFW_MODIFIER_RIGHT_ALT;
+	last_modifiers = e->modifiers;
 }
 
 static void
 handle_key_press (VKFWevent *e, xcb_key_press_event_t *xe)
 {
+	vkfwXcbXkbUpdateKeymap ();
+
 	VKFWxcbwindow *window = vkfwXcbXIDToWindow (xe->event);
 	if (!window)
 		return;
@@ -51,6 +62,8 @@ handle_key_press (VKFWevent *e, xcb_key_press_event_t *xe)
 static void
 handle_key_release (VKFWevent *e, xcb_key_release_event_t *xe)
 {
+	vkfwXcbXkbUpdateKeymap ();
+
 	VKFWxcbwindow *window = vkfwXcbXIDToWindow (xe->event);
 	if (!window)
 		return;
@@ -148,6 +161,14 @@ handle_motion_notify (VKFWevent *e, xcb_motion_notify_event_t *xe)
 		return;
 	}
 
+	/** with XInput2, relative motion comes from XI_RawMotion */
+	if (vkfw_has_xi2 && (window->pointer_mode & VKFW_POINTER_RELATIVE)) {
+		set_modifiers (e, xe->state);
+		window->last_x = xe->event_x;
+		window->last_y = xe->event_y;
+		return;
+	}
+
 	e->type = VKFW_EVENT_POINTER_MOTION;
 	e->window = (VKFWwindow *) window;
 	e->x = xe->event_x;
@@ -161,12 +182,12 @@ handle_motion_notify (VKFWevent *e, xcb_motion_notify_event_t *xe)
 
 		/** realign the mouse */
 		if (window->warp_x == -1 && window->warp_y == -1 && (e->x || e->y)) {
-			window->warp_x = window->window.extent.width / 2;
-			window->warp_y = window->window.extent.height / 2;
+			VkExtent2D extent = window->window.extent.load (std::memory_order_relaxed);
+			window->warp_x = extent.width / 2;
+			window->warp_y = extent.height / 2;
 			xcb_warp_pointer (vkfw_xcb_connection, window->wid,
-				window->wid, 0, 0, window->window.extent.width,
-				window->window.extent.height, window->warp_x,
-				window->warp_y);
+				window->wid, 0, 0, extent.width, extent.height,
+				window->warp_x, window->warp_y);
 		}
 	}
 
@@ -214,11 +235,110 @@ handle_focus_out (VKFWevent *e, xcb_focus_out_event_t *xe)
 		vkfw_xcb_focus_window = nullptr;
 }
 
+static void
+update_visibility (VKFWevent *e, VKFWxcbwindow *window)
+{
+	int visibility = VKFW_VISIBILITY_VISIBLE;
+	if (!window->mapped)
+		visibility = VKFW_VISIBILITY_HIDDEN;
+	else if (window->net_wm_hidden)
+		visibility = VKFW_VISIBILITY_SUSPENDED;
+	else if (window->obscured)
+		visibility = VKFW_VISIBILITY_OCCLUDED;
+
+	e->type = vkfwUpdateWindowVisibility ((VKFWwindow *) window, visibility);
+	e->window = (VKFWwindow *) window;
+}
+
 static void
 handle_map_notify (VKFWevent *e, xcb_map_notify_event_t *xe)
 {
-	(void) e;
-	(void) xe;
+	VKFWxcbwindow *window = vkfwXcbXIDToWindow (xe->window);
+	if (!window)
+		return;
+
+	window->mapped = true;
+	update_visibility (e, window);
+}
+
+static void
+handle_unmap_notify (VKFWevent *e, xcb_unmap_notify_event_t *xe)
+{
+	VKFWxcbwindow *window = vkfwXcbXIDToWindow (xe->window);
+	if (!window)
+		return;
+
+	window->mapped = false;
+	update_visibility (e, window);
+}
+
+static void
+handle_visibility_notify (VKFWevent *e, xcb_visibility_notify_event_t *xe)
+{
+	VKFWxcbwindow *window = vkfwXcbXIDToWindow (xe->window);
+	if (!window)
+		return;
+
+	window->obscured = xe->state == XCB_VISIBILITY_FULLY_OBSCURED;
+	update_visibility (e, window);
+}
+
+/**
+ * Window managers that keep minimized windows mapped set _NET_WM_STATE_HIDDEN
+ * on them instead. Some window managers change _NET_WM_STATE on every focus
+ * change, so it is read asynchronously. Only the reply to the latest request,
+ * whose cookie is kept in the window, is used.
+ */
+static void
+handle_net_wm_state_reply (VKFWxcbwindow *window, uint32_t sequence, void *data)
+{
+	if (window->net_wm_state_cookie.sequence != sequence)
+		return;
+
+	window->net_wm_state_cookie.sequence = 0;
+	xcb_get_property_reply_t *reply = (xcb_get_property_reply_t *) data;
+	if (!reply)
+		return;
+
+	xcb_atom_t *atoms = (xcb_atom_t *) xcb_get_property_value (reply);
+	int n = xcb_get_property_value_length (reply) / sizeof (xcb_atom_t);
+
+	bool hidden = false;
+	for (int i = 0; i < n; i++) {
+		if (atoms[i] == vkfw__NET_WM_STATE_HIDDEN)
+			hidden = true;
+	}
+
+	window->net_wm_hidden = hidden;
+
+	VKFWevent e;
+	e.type = VKFW_EVENT_NONE;
+	update_visibility (&e, window);
+	if (e.type != VKFW_EVENT_NULL)
+		vkfwSendEventToApplication (&e);
+}
+
+static void
+handle_property_notify (VKFWevent *e, xcb_property_notify_event_t *xe)
+{
+	if (!vkfw__NET_WM_STATE || xe->atom != vkfw__NET_WM_STATE)
+		return;
+
+	VKFWxcbwindow *window = vkfwXcbXIDToWindow (xe->window);
+	if (!window)
+		return;
+
+	if (xe->state != XCB_PROPERTY_NEW_VALUE || !vkfw__NET_WM_STATE_HIDDEN) {
+		window->net_wm_state_cookie.sequence = 0;
+		window->net_wm_hidden = false;
+		update_visibility (e, window);
+		return;
+	}
+
+	window->net_wm_state_cookie = xcb_get_property (vkfw_xcb_connection,
+		0, window->wid, vkfw__NET_WM_STATE, XCB_ATOM_ATOM, 0, 32);
+	vkfwXcbTrackReply (window->net_wm_state_cookie.sequence, window,
+		handle_net_wm_state_reply);
 }
 
 static void
@@ -247,6 +367,8 @@ handle_configure_notify (VKFWevent *e, xcb_configure_notify_event_t *xe)
 	if (!window)
 		return;
 
+	vkfwXcbSyncConfigure (window);
+
 	e->type = VKFW_EVENT_WINDOW_RESIZE_NOTIFY;
 	e->window = (VKFWwindow *) window;
 	e->extent.width = xe->width;
@@ -267,12 +389,11 @@ handle_wm_protocols_message (VKFWevent *e, xcb_client_message_event_t *xe)
 		 * to the root window with event->window set to the root window.
 		 */
 		xe->window = vkfw_xcb_default_screen->root;
-		xcb_void_cookie_t cookie = xcb_send_event_checked (vkfw_xcb_connection, 0,
+		xcb_void_cookie_t cookie = xcb_send_event (vkfw_xcb_connection, 0,
 			vkfw_xcb_default_screen->root,
 			XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY
 			| XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT, (const char *) xe);
-		if (vkfwXcbCheck (cookie))
-			vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: got an error when responding to _NET_WM_PING\n");
+		vkfwXcbTrackRequest (cookie, "SendEvent(_NET_WM_PING)", nullptr);
 	} else if (msg == vkfw_WM_DELETE_WINDOW) {
 		/**
 		 * WM_DELETE_WINDOW: the window manager sends this event to
@@ -284,6 +405,14 @@ handle_wm_protocols_message (VKFWevent *e, xcb_client_message_event_t *xe)
 		 */
 		e->type = VKFW_EVENT_WINDOW_CLOSE_REQUEST;
 		e->window = (VKFWwindow *) vkfwXcbXIDToWindow (xe->window);
+	} else if (msg == vkfw__NET_WM_SYNC_REQUEST) {
+		/**
+		 * _NET_WM_SYNC_REQUEST: the window manager sends this event
+		 * before it resizes the window, see wm_sync.cc.
+		 */
+		VKFWxcbwindow *window = vkfwXcbXIDToWindow (xe->window);
+		if (window)
+			vkfwXcbHandleSyncRequest (window, xe);
 	} else
 		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: unknown WM_PROTOCOLS message %" PRIu32 "\n", msg);
 }
@@ -299,18 +428,36 @@ handle_client_message (VKFWevent *e, xcb_client_message_event_t *xe)
 	 * (such as the window manager).
 	 */
 
-	if (xe->type == vkfw_WM_PROTOCOLS)
+	if (xe->type == vkfw_WM_PROTOCOLS) {
 		handle_wm_protocols_message (e, xe);
+		return;
+	}
+
+	/**
+	 * _NET_WM_FRAME_DRAWN and _NET_WM_FRAME_TIMINGS: the compositor
+	 * sends these after it has drawn a frame, see wm_sync.cc.
+	 */
+	VKFWxcbwindow *window = vkfwXcbXIDToWindow (xe->window);
+	if (!window)
+		return;
+
+	if (xe->type == vkfw__NET_WM_FRAME_DRAWN)
+		vkfwXcbHandleFrameDrawn (e, window, xe);
+	else if (xe->type == vkfw__NET_WM_FRAME_TIMINGS)
+		vkfwXcbHandleFrameTimings (window, xe);
 }
 
 static void
 handle_generic_event (VKFWevent *e, xcb_ge_generic_event_t *xe)
 {
 	/**
-	 * TODO: what is this? Do we need to handle it in any way?
+	 * GenericEvent is used by extensions that need larger events than
+	 * the core protocol allows. The only one we select is XInput2.
 	 */
-	(void) e;
-	(void) xe;
+	if (vkfw_has_xi2 && xe->extension == vkfw_xi2_opcode) {
+		vkfwXcbHandleXIEvent (e, xe);
+		e->modifiers = last_modifiers;
+	}
 }
 
 struct vkfw_xkb_generic_event {
@@ -325,7 +472,13 @@ handle_event (VKFWevent *e, xcb_generic_event_t *xe)
 
 	uint8_t t = xe->response_type & 0x7f;
 
+	vkfwXcbRetireRequests (xe->full_sequence);
+	vkfwXcbPollReplies ();
+
 	switch (t) {
+	case 0:
+		vkfwXcbHandleError ((xcb_generic_error_t *) xe);
+		break;
 	case XCB_KEY_PRESS:
 		handle_key_press (e, (xcb_key_press_event_t *) xe);
 		break;
@@ -350,6 +503,15 @@ handle_event (VKFWevent *e, xcb_generic_event_t *xe)
 	case XCB_MAP_NOTIFY:
 		handle_map_notify (e, (xcb_map_notify_event_t *) xe);
 		break;
+	case XCB_UNMAP_NOTIFY:
+		handle_unmap_notify (e, (xcb_unmap_notify_event_t *) xe);
+		break;
+	case XCB_VISIBILITY_NOTIFY:
+		handle_visibility_notify (e, (xcb_visibility_notify_event_t *) xe);
+		break;
+	case XCB_PROPERTY_NOTIFY:
+		handle_property_notify (e, (xcb_property_notify_event_t *) xe);
+		break;
 	case XCB_REPARENT_NOTIFY:
 		handle_reparent_notify (e, (xcb_reparent_notify_event_t *) xe);
 		break;
@@ -375,6 +537,9 @@ handle_event (VKFWevent *e, xcb_generic_event_t *xe)
 			case XCB_XKB_STATE_NOTIFY:
 				vkfwXcbXkbStateNotify ((xcb_xkb_state_notify_event_t *) xe);
 				break;
+			case XCB_XKB_NAMES_NOTIFY:
+				vkfwXcbXkbNamesNotify ((xcb_xkb_names_notify_event_t *) xe);
+				break;
 			}
 		} else
 			vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: unhandled event type %u\n", xe->response_type);
@@ -383,27 +548,99 @@ handle_event (VKFWevent *e, xcb_generic_event_t *xe)
 	free (xe);
 }
 
+/**
+ *   Input thread support.
+ *
+ * The input thread blocks in xcb_wait_for_event rather than on the socket, as
+ * libxcb also wakes it up when the application thread reads events from the
+ * socket while waiting for a reply. The event is stashed until the input
+ * thread dispatches events.
+ *
+ * To wake up the input thread, we send a ClientMessage to a private InputOnly
+ * window. handle_client_message ignores it, as its type is XCB_ATOM_NONE.
+ */
+static xcb_generic_event_t *stashed_event;
+static xcb_window_t wakeup_window;
+
 VkResult
-vkfwXcbGetEvent (VKFWevent *e, int mode, uint64_t timeout)
+vkfwXcbInitInputThread (void)
 {
-	xcb_generic_event_t *xe;
+	wakeup_window = xcb_generate_id (vkfw_xcb_connection);
+	xcb_void_cookie_t cookie = xcb_create_window_checked (vkfw_xcb_connection,
+		0, wakeup_window, vkfw_xcb_default_screen->root,
+		0, 0, 1, 1, 0, XCB_WINDOW_CLASS_INPUT_ONLY,
+		XCB_COPY_FROM_PARENT, 0, nullptr);
+
+	if (vkfwXcbCheck (cookie)) {
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: failed to create the input thread wakeup window\n");
+		wakeup_window = XCB_WINDOW_NONE;
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
 
 	/**
-	 * Indefinite timeout: fall back to xcb_wait_for_event.
+	 * The application thread no longer reads from the connection, so it
+	 * should not wake up when the socket becomes readable.
 	 */
-	if (timeout == UINT64_MAX) {
-		xe = xcb_wait_for_event (vkfw_xcb_connection);
+	vkfwCurrentPlatform->removeWaitFd (xcb_get_file_descriptor (vkfw_xcb_connection));
+	return VK_SUCCESS;
+}
 
-		if (xe)
-			handle_event (e, xe);
-		else if (xcb_connection_has_error (vkfw_xcb_connection))
-			return VK_ERROR_SURFACE_LOST_KHR;
+VkResult
+vkfwXcbWaitInput (void)
+{
+	/**
+	 * Requests made while translating events (xcb_warp_pointer, ...) must
+	 * reach the server before we go to sleep.
+	 */
+	xcb_flush (vkfw_xcb_connection);
+
+	if (!stashed_event)
+		stashed_event = xcb_wait_for_event (vkfw_xcb_connection);
+	if (!stashed_event)
+		return VK_ERROR_SURFACE_LOST_KHR;
+	return VK_SUCCESS;
+}
+
+void
+vkfwXcbWakeInputThread (void)
+{
+	xcb_client_message_event_t xe {};
+	xe.response_type = XCB_CLIENT_MESSAGE;
+	xe.format = 32;
+	xe.window = wakeup_window;
+	xe.type = XCB_ATOM_NONE;
+
+	xcb_send_event (vkfw_xcb_connection, 0, wakeup_window,
+		XCB_EVENT_MASK_NO_EVENT, (const char *) &xe);
+	xcb_flush (vkfw_xcb_connection);
+}
+
+void
+vkfwXcbCancelInputThread (void)
+{
+	xcb_destroy_window (vkfw_xcb_connection, wakeup_window);
+	wakeup_window = XCB_WINDOW_NONE;
+
+	if (vkfwCurrentPlatform->addWaitFd (xcb_get_file_descriptor (vkfw_xcb_connection),
+		VKFW_FD_READABLE, nullptr, nullptr) != VK_SUCCESS)
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: failed to add the connection back to the wait set\n");
+}
+
+VkResult
+vkfwXcbGetEvent (VKFWevent *e, int mode, uint64_t timeout)
+{
+	xcb_generic_event_t *xe;
 
+	if (stashed_event) {
+		xe = stashed_event;
+		stashed_event = nullptr;
+		handle_event (e, xe);
 		return VK_SUCCESS;
 	}
 
 	/**
-	 * Non-zero timeout: poll the XCB file descriptor.
+	 * Non-zero timeout: wait for the XCB file descriptor (or anything else
+	 * in the wait set).
 	 */
 	if (timeout) {
 		/**
@@ -418,26 +655,10 @@ vkfwXcbGetEvent (VKFWevent *e, int mode, uint64_t timeout)
 			return VK_SUCCESS;
 		}
 
-		struct pollfd fds[] = {
-			{ xcb_get_file_descriptor (vkfw_xcb_connection), POLLIN, 0 }
-		};
-
-		/**
-		 * If we are using deadline mode, we would really want a poll(2)
-		 * with an absolute expiry time instead of a timeout. To the
-		 * best of my knowledge, there exists no convenient way to do
-		 * this currently (epoll?).
-		 */
-		if (mode == VKFW_EVENT_MODE_DEADLINE) {
-			uint64_t now = vkfwGetTime ();
-			if (timeout > now)
-				timeout -= now;
-			else
-				timeout = 0;
-		}
+		if (mode == VKFW_EVENT_MODE_TIMEOUT && timeout != UINT64_MAX)
+			timeout += vkfwGetTime ();
 
-		timeout = (timeout + 999) / 1000;
-		poll (fds, 1, timeout);
+		vkfwCurrentPlatform->waitUntil (timeout);
 	}
 
 	xe = xcb_poll_for_event (vkfw_xcb_connection);
@@ -445,6 +666,97 @@ vkfwXcbGetEvent (VKFWevent *e, int mode, uint64_t timeout)
 		handle_event (e, xe);
 	else if (xcb_connection_has_error (vkfw_xcb_connection))
 		return VK_ERROR_SURFACE_LOST_KHR;
+	else {
+		vkfwXcbPollReplies ();
+		vkfwXcbXkbUpdateKeymap ();
+	}
 
 	return VK_SUCCESS;
 }
+
+/**
+ * Translate and send everything that libxcb has queued, reading from the
+ * socket at most once. Returns false if the batch was cut short because the
+ * event queue is full.
+ */
+static bool
+dispatch_batch (void)
+{
+	bool read_socket = false;
+	xcb_generic_event_t *xe;
+	VKFWevent e;
+
+	for (;;) {
+		if (vkfwEventQueueFull ())
+			return false;
+
+		xe = stashed_event;
+		stashed_event = nullptr;
+		if (!xe)
+			xe = xcb_poll_for_queued_event (vkfw_xcb_connection);
+		if (!xe && !read_socket) {
+			read_socket = true;
+			xe = xcb_poll_for_event (vkfw_xcb_connection);
+		}
+		if (!xe) {
+			vkfwXcbPollReplies ();
+			vkfwXcbXkbUpdateKeymap ();
+			return true;
+		}
+
+		e.type = VKFW_EVENT_NONE;
+		e.window = nullptr;
+		handle_event (&e, xe);
+		if (e.type != VKFW_EVENT_NULL && e.type != VKFW_EVENT_NONE)
+			vkfwSendEventToApplication (&e);
+	}
+}
+
+VkResult
+vkfwXcbDispatchEvents (int mode, uint64_t timeout)
+{
+	if (mode == VKFW_EVENT_MODE_TIMEOUT && timeout && timeout != UINT64_MAX)
+		timeout += vkfwGetTime ();
+
+	for (;;) {
+		bool complete;
+		{
+			std::scoped_lock g (vkfw_input_mu);
+			complete = dispatch_batch ();
+
+			/**
+			 * Requests made while translating events
+			 * (xcb_warp_pointer, replies to _NET_WM_PING, ...)
+			 * are flushed once per batch.
+			 */
+			xcb_flush (vkfw_xcb_connection);
+		}
+
+		if (xcb_connection_has_error (vkfw_xcb_connection))
+			return VK_ERROR_SURFACE_LOST_KHR;
+
+		vkfwFlushEvents ();
+
+		/**
+		 * If the batch was cut short, go on with the rest of it once
+		 * the main thread has taken the events, unless the application
+		 * has no room for them.
+		 */
+		if (!complete) {
+			if (vkfwEventQueueFull ())
+				return VK_SUCCESS;
+			continue;
+		}
+
+		if (!timeout || vkfwGetTime () >= timeout || vkfwShouldStopDispatch ())
+			return VK_SUCCESS;
+
+		vkfwCurrentPlatform->waitUntil (timeout);
+	}
+}
+
+void
+vkfwXcbFlush (void)
+{
+	xcb_flush (vkfw_xcb_connection);
+}
@@ -7,3 +7,21 @@
 
 VkResult
 vkfwXcbGetEvent (VKFWevent *e, int mode, uint64_t timeout);
+
+VkResult
+vkfwXcbDispatchEvents (int mode, uint64_t timeout);
+
+void
+vkfwXcbFlush (void);
+
+VkResult
+vkfwXcbInitInputThread (void);
+
+VkResult
+vkfwXcbWaitInput (void);
+
+void
+vkfwXcbWakeInputThread (void);
+
+void
+vkfwXcbCancelInputThread (void);
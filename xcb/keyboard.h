@@ -13,12 +13,6 @@ vkfwXcbInitKeyboard (void);
 void
 vkfwXcbTerminateKeyboard (void);
 
-int
-vkfwXcbTranslateKeycode (int keycode);
-
-int
-vkfwXcbTranslateKey (int key);
-
 extern bool vkfw_has_xkb;
 extern uint8_t vkfw_xkb_event_base;
 
@@ -28,6 +22,16 @@ vkfwXcbXkbNewKeyboardNotify (xcb_xkb_new_keyboard_notify_event_t *e);
 void
 vkfwXcbXkbMapNotify (xcb_xkb_map_notify_event_t *e);
 
+void
+vkfwXcbXkbNamesNotify (xcb_xkb_names_notify_event_t *e);
+
+/**
+ * Fetch the keymap from the server if an XKB notify has changed it since the
+ * last call.
+ */
+void
+vkfwXcbXkbUpdateKeymap (void);
+
 void
 vkfwXcbXkbStateNotify (xcb_xkb_state_notify_event_t *e);
 
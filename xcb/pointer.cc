@@ -0,0 +1,213 @@
+/**
+ * XInput2 pointer input.
+ * Copyright (C) 2024  dbstream
+ */
+#include <VKFW/logging.h>
+#include <VKFW/platform.h>
+#include <VKFW/vkfw.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pointer.h"
+#include "window.h"
+#include "xcb.h"
+
+/**
+ * In VKFW_POINTER_RELATIVE mode, deltas are taken from XI_RawMotion events
+ * rather than from MotionNotify. Raw motion is unaccelerated, has sub-pixel
+ * precision, and doesn't stop at the edge of the window or the screen, so we
+ * don't need to warp the pointer back to the center of the window.
+ *
+ * Raw events are only delivered to the root window and don't say which window
+ * they are for; they are delivered to the focused window.
+ *
+ * If XInput2 is not available, event.cc falls back to computing deltas from
+ * MotionNotify and warping the pointer.
+ */
+
+bool vkfw_has_xi2;
+uint8_t vkfw_xi2_opcode;
+
+static void *libxcb_xinput_handle;
+
+static void
+unload_xinput (void)
+{
+	vkfw_has_xi2 = false;
+	vkfwCurrentPlatform->unloadModule (libxcb_xinput_handle);
+}
+
+#define VKFW_XINPUT_DEFINE_FUNC(name) PFN##name name;
+VKFW_XCB_XINPUT_ALL_FUNCS(VKFW_XINPUT_DEFINE_FUNC)
+#undef VKFW_XINPUT_DEFINE_FUNC
+
+static void
+load_xinput (void)
+{
+	libxcb_xinput_handle = vkfwCurrentPlatform->loadModule ("libxcb-xinput.so.0");
+	if (!libxcb_xinput_handle)
+		libxcb_xinput_handle = vkfwCurrentPlatform->loadModule ("libxcb-xinput.so");
+	if (!libxcb_xinput_handle) {
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: libxcb-xinput is not present\n");
+		return;
+	}
+
+	bool failed = false;
+#define VKFW_XINPUT_LOAD_FUNC(name)								\
+	name = (PFN##name) vkfwCurrentPlatform->lookupSymbol (libxcb_xinput_handle, #name);	\
+	if (!name)										\
+		failed = true;
+	VKFW_XCB_XINPUT_ALL_FUNCS(VKFW_XINPUT_LOAD_FUNC)
+#undef VKFW_XINPUT_LOAD_FUNC
+
+	if (failed) {
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: failed to load some libxcb-xinput symbols\n");
+		unload_xinput ();
+		return;
+	}
+
+	vkfw_has_xi2 = true;
+}
+
+static bool
+setup_xinput (void)
+{
+	static const char name[] = "XInputExtension";
+
+	/**
+	 * libxcb shuts the connection down if we make a request to an
+	 * extension that the server doesn't have, so check that it is present
+	 * first.
+	 */
+	xcb_query_extension_reply_t *ext = xcb_query_extension_reply (vkfw_xcb_connection,
+		xcb_query_extension (vkfw_xcb_connection, strlen (name), name), nullptr);
+	if (!ext || !ext->present) {
+		free (ext);
+		return false;
+	}
+
+	vkfw_xi2_opcode = ext->major_opcode;
+	free (ext);
+
+	/**
+	 * Ask for XI 2.1, in which raw events are delivered even while the
+	 * pointer is grabbed. The server must know our XI2 version before we
+	 * can select XI2 events.
+	 */
+	xcb_input_xi_query_version_reply_t *version = xcb_input_xi_query_version_reply (
+		vkfw_xcb_connection, xcb_input_xi_query_version (vkfw_xcb_connection, 2, 1),
+		nullptr);
+
+	bool ok = version && version->major_version >= 2;
+	if (ok)
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: XInput %" PRIu16 ".%" PRIu16 " opcode=%u\n",
+			version->major_version, version->minor_version, vkfw_xi2_opcode);
+
+	free (version);
+	return ok;
+}
+
+void
+vkfwXcbInitPointer (void)
+{
+	load_xinput ();
+	if (vkfw_has_xi2 && !setup_xinput ())
+		unload_xinput ();
+
+	if (vkfw_has_xi2)
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: using XInput2 for relative pointer motion\n");
+	else
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: XInput2 is not available. Relative pointer motion will warp the pointer\n");
+}
+
+void
+vkfwXcbTerminatePointer (void)
+{
+	if (vkfw_has_xi2)
+		unload_xinput ();
+}
+
+static unsigned int raw_motion_users;
+
+void
+vkfwXcbSelectRawMotion (bool enable)
+{
+	if (enable ? raw_motion_users++ : --raw_motion_users)
+		return;
+
+	struct {
+		xcb_input_event_mask_t head;
+		uint32_t mask;
+	} mask;
+
+	mask.head.deviceid = XCB_INPUT_DEVICE_ALL_MASTER;
+	mask.head.mask_len = 1;
+	mask.mask = enable ? XCB_INPUT_XI_EVENT_MASK_RAW_MOTION : 0;
+
+	xcb_void_cookie_t cookie = xcb_input_xi_select_events (vkfw_xcb_connection,
+		vkfw_xcb_default_screen->root, 1, &mask.head);
+	vkfwXcbTrackRequest (cookie, "XISelectEvents(XI_RawMotion)", nullptr);
+}
+
+static int64_t
+fp3232_to_int64 (xcb_input_fp3232_t v)
+{
+	return (int64_t) ((uint64_t) (int64_t) v.integral << 32) + v.frac;
+}
+
+/**
+ * Add a 32.32 fixed-point delta to *acc and return the whole pixels. The
+ * fractional part is kept in *acc for the next event.
+ */
+static int
+take_whole_pixels (int64_t *acc, int64_t delta)
+{
+	*acc += delta;
+	int whole = (int) (*acc >> 32);
+	*acc -= (int64_t) whole * ((int64_t) 1 << 32);
+	return whole;
+}
+
+static void
+handle_raw_motion (VKFWevent *e, xcb_input_raw_motion_event_t *xe)
+{
+	VKFWxcbwindow *window = vkfw_xcb_focus_window;
+	if (!window || !(window->pointer_mode & VKFW_POINTER_RELATIVE))
+		return;
+
+	/**
+	 * The event carries values for the valuators that are set in the
+	 * mask, in order. Valuators 0 and 1 are the X and Y axes.
+	 */
+	uint32_t *valuator_mask = xcb_input_raw_button_press_valuator_mask (xe);
+	xcb_input_fp3232_t *values = xcb_input_raw_button_press_axisvalues_raw (xe);
+	int64_t delta[2] = { 0, 0 };
+
+	if (!xe->valuators_len)
+		return;
+
+	for (int i = 0; i < 2; i++) {
+		if (valuator_mask[0] & (1U << i))
+			delta[i] = fp3232_to_int64 (*values++);
+	}
+
+	int x = take_whole_pixels (&window->raw_x, delta[0]);
+	int y = take_whole_pixels (&window->raw_y, delta[1]);
+	if (!x && !y)
+		return;
+
+	e->type = VKFW_EVENT_RELATIVE_POINTER_MOTION;
+	e->window = (VKFWwindow *) window;
+	e->x = x;
+	e->y = y;
+}
+
+void
+vkfwXcbHandleXIEvent (VKFWevent *e, xcb_ge_generic_event_t *xe)
+{
+	switch (xe->event_type) {
+	case XCB_INPUT_RAW_MOTION:
+		handle_raw_motion (e, (xcb_input_raw_motion_event_t *) xe);
+		break;
+	}
+}
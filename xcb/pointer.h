@@ -0,0 +1,31 @@
+/**
+ * XInput2 pointer input
+ * Copyright (C) 2024  dbstream
+ */
+
+#include "xcb_xinput.h"
+#include <VKFW/vkfw.h>
+#include <stdint.h>
+
+void
+vkfwXcbInitPointer (void);
+
+void
+vkfwXcbTerminatePointer (void);
+
+extern bool vkfw_has_xi2;
+extern uint8_t vkfw_xi2_opcode;
+
+/**
+ * Start or stop receiving XI_RawMotion events. Calls nest; raw motion is
+ * selected while at least one window is in VKFW_POINTER_RELATIVE mode.
+ */
+void
+vkfwXcbSelectRawMotion (bool enable);
+
+/**
+ * Handle an XInput2 event. This fills in a VKFW_EVENT_RELATIVE_POINTER_MOTION
+ * event for the focused window if it is in relative mode.
+ */
+void
+vkfwXcbHandleXIEvent (VKFWevent *e, xcb_ge_generic_event_t *xe);
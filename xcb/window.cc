@@ -3,6 +3,7 @@
  * Copyright (C) 2024  dbstream
  */
 #define VK_USE_PLATFORM_XCB_KHR
+#include <VKFW/event.h>
 #include <VKFW/logging.h>
 #include <VKFW/vector.h>
 #include <VKFW/vkfw.h>
@@ -10,48 +11,271 @@
 #include <inttypes.h>
 #include <stdlib.h>
 #include <xcb/xcb_atom.h>
+#include <atomic>
 #include <mutex>
+#include <new>
+#include "pointer.h"
 #include "window.h"
+#include "wm_sync.h"
 #include "xcb.h"
 
-struct wid_window_pair {
-	xcb_window_t id;
-	VKFWxcbwindow *window;
+/**
+ *   The XID to window map.
+ *
+ * Every event is mapped from its XID to a VKFWxcbwindow, so lookups are on
+ * the hot path. The map is an open-addressing hash table with linear probing.
+ * Writers (window creation and destruction) are serialized by wid_map_mu.
+ * Readers don't take any lock; instead, writers keep wid_map_seq odd for the
+ * duration of a modification, and readers retry if it changed while they
+ * were looking.
+ *
+ * Removal shifts the following entries of the probe sequence back instead of
+ * leaving a tombstone, so the table is only rebuilt when it needs to grow.
+ * The old table is retired rather than freed, as a reader may still be
+ * looking at it. Tables grow geometrically, so retired tables never take up
+ * more memory than the current one.
+ */
+static constexpr xcb_window_t WID_EMPTY = XCB_WINDOW_NONE;
+
+static constexpr uint32_t WID_MAP_MIN_SIZE = 16;
+
+struct wid_map_slot {
+	std::atomic<xcb_window_t> id;
+	std::atomic<VKFWxcbwindow *> window;
 };
 
-static VKFWvector<wid_window_pair> wid_to_window_map;
-static std::mutex wid_to_window_mu;
+struct wid_map_table {
+	uint32_t mask;
+	wid_map_slot *slots;
+	wid_map_table *retired;
+};
+
+static std::atomic<wid_map_table *> wid_map;
+static std::atomic<uint32_t> wid_map_seq;
+static std::mutex wid_map_mu;
+
+/** Number of entries in wid_map. */
+static uint32_t wid_map_live;
+
+/**
+ * The last successful lookup on this thread. It is valid for as long as
+ * wid_map_seq doesn't change.
+ */
+static thread_local uint32_t last_hit_seq = 1;
+static thread_local xcb_window_t last_hit_id;
+static thread_local VKFWxcbwindow *last_hit_window;
+
+static uint32_t
+hash_wid (xcb_window_t id)
+{
+	uint32_t h = id * 0x9e3779b1U;
+	return h ^ (h >> 16);
+}
+
+static void
+wid_map_write_begin (void)
+{
+	wid_map_seq.store (wid_map_seq.load (std::memory_order_relaxed) + 1,
+		std::memory_order_relaxed);
+	std::atomic_thread_fence (std::memory_order_release);
+}
+
+static void
+wid_map_write_end (void)
+{
+	wid_map_seq.store (wid_map_seq.load (std::memory_order_relaxed) + 1,
+		std::memory_order_release);
+}
+
+static wid_map_table *
+alloc_wid_map (uint32_t size)
+{
+	wid_map_table *t = new (std::nothrow) wid_map_table;
+	if (!t)
+		return nullptr;
+
+	t->slots = new (std::nothrow) wid_map_slot[size] ();
+	if (!t->slots) {
+		delete t;
+		return nullptr;
+	}
+
+	t->mask = size - 1;
+	t->retired = nullptr;
+	return t;
+}
+
+static void
+insert_slot (wid_map_table *t, xcb_window_t id, VKFWxcbwindow *window)
+{
+	uint32_t i = hash_wid (id) & t->mask;
+	while (t->slots[i].id.load (std::memory_order_relaxed) != WID_EMPTY)
+		i = (i + 1) & t->mask;
+
+	t->slots[i].window.store (window, std::memory_order_relaxed);
+	t->slots[i].id.store (id, std::memory_order_relaxed);
+}
+
+/**
+ * Rebuild the table with room for at least one more entry.
+ */
+static bool
+rebuild_wid_map (void)
+{
+	uint32_t size = WID_MAP_MIN_SIZE;
+	while (size * 3 / 4 < 2 * (wid_map_live + 1))
+		size *= 2;
+
+	wid_map_table *t = alloc_wid_map (size);
+	if (!t)
+		return false;
+
+	wid_map_table *old = wid_map.load (std::memory_order_relaxed);
+	if (old) {
+		for (uint32_t i = 0; i <= old->mask; i++) {
+			xcb_window_t id = old->slots[i].id.load (std::memory_order_relaxed);
+			if (id != WID_EMPTY)
+				insert_slot (t, id, old->slots[i].window.load (std::memory_order_relaxed));
+		}
+	}
+
+	t->retired = old;
+	wid_map.store (t, std::memory_order_release);
+	return true;
+}
+
+/**
+ * Empty slot i, and move later entries of the probe sequence back so that
+ * lookups never stop at an empty slot before reaching them. An entry at j
+ * can fill the hole at i if i lies on its probe sequence, from its home slot
+ * up to j.
+ */
+static void
+remove_slot (wid_map_table *t, uint32_t i)
+{
+	for (uint32_t j = (i + 1) & t->mask;; j = (j + 1) & t->mask) {
+		xcb_window_t id = t->slots[j].id.load (std::memory_order_relaxed);
+		if (id == WID_EMPTY)
+			break;
+
+		uint32_t home = hash_wid (id) & t->mask;
+		if (((j - home) & t->mask) < ((j - i) & t->mask))
+			continue;
+
+		t->slots[i].window.store (t->slots[j].window.load (std::memory_order_relaxed),
+			std::memory_order_relaxed);
+		t->slots[i].id.store (id, std::memory_order_relaxed);
+		i = j;
+	}
+
+	t->slots[i].id.store (WID_EMPTY, std::memory_order_relaxed);
+	t->slots[i].window.store (nullptr, std::memory_order_relaxed);
+}
 
 static bool
 register_window_wid (xcb_window_t id, VKFWxcbwindow *window)
 {
-	std::scoped_lock g (wid_to_window_mu);
-	return wid_to_window_map.push_back ({id, window});
+	std::scoped_lock g (wid_map_mu);
+
+	wid_map_table *t = wid_map.load (std::memory_order_relaxed);
+	if (!t || (wid_map_live + 1) * 4 > (t->mask + 1) * 3) {
+		if (!rebuild_wid_map ())
+			return false;
+		t = wid_map.load (std::memory_order_relaxed);
+	}
+
+	wid_map_write_begin ();
+	insert_slot (t, id, window);
+	wid_map_live++;
+	wid_map_write_end ();
+	return true;
 }
 
 static void
 unregister_window_wid (xcb_window_t id)
 {
-	std::scoped_lock g (wid_to_window_mu);
-	size_t n = wid_to_window_map.size () - 1;
-	for (size_t i = 0; i <= n; i++) {
-		if (wid_to_window_map[i].id == id) {
-			if (i < n)
-				wid_to_window_map[i] = wid_to_window_map[n];
-			wid_to_window_map.pop_back ();
+	std::scoped_lock g (wid_map_mu);
+
+	wid_map_table *t = wid_map.load (std::memory_order_relaxed);
+	if (!t)
+		return;
+
+	uint32_t i = hash_wid (id) & t->mask;
+	for (uint32_t n = 0; n <= t->mask; n++, i = (i + 1) & t->mask) {
+		xcb_window_t slot_id = t->slots[i].id.load (std::memory_order_relaxed);
+		if (slot_id == WID_EMPTY)
 			return;
-		}
+		if (slot_id != id)
+			continue;
+
+		wid_map_write_begin ();
+		remove_slot (t, i);
+		wid_map_live--;
+		wid_map_write_end ();
+		return;
 	}
 }
 
+static VKFWxcbwindow *
+lookup_wid (wid_map_table *t, xcb_window_t id)
+{
+	uint32_t i = hash_wid (id) & t->mask;
+	for (uint32_t n = 0; n <= t->mask; n++, i = (i + 1) & t->mask) {
+		xcb_window_t slot_id = t->slots[i].id.load (std::memory_order_relaxed);
+		if (slot_id == WID_EMPTY)
+			return nullptr;
+		if (slot_id == id)
+			return t->slots[i].window.load (std::memory_order_relaxed);
+	}
+	return nullptr;
+}
+
 VKFWxcbwindow *
 vkfwXcbXIDToWindow (xcb_window_t wid)
 {
-	std::scoped_lock g (wid_to_window_mu);
-	for (const wid_window_pair &p : wid_to_window_map)
-		if (p.id == wid)
-			return p.window;
-	return nullptr;
+	for (;;) {
+		uint32_t seq = wid_map_seq.load (std::memory_order_acquire);
+		if (seq & 1)
+			continue;
+
+		if (seq == last_hit_seq && wid == last_hit_id)
+			return last_hit_window;
+
+		VKFWxcbwindow *window = nullptr;
+		wid_map_table *t = wid_map.load (std::memory_order_acquire);
+		if (t)
+			window = lookup_wid (t, wid);
+
+		std::atomic_thread_fence (std::memory_order_acquire);
+		if (wid_map_seq.load (std::memory_order_relaxed) != seq)
+			continue;
+
+		if (window) {
+			last_hit_seq = seq;
+			last_hit_id = wid;
+			last_hit_window = window;
+		}
+		return window;
+	}
+}
+
+void
+vkfwXcbFreeWindowMap (void)
+{
+	std::scoped_lock g (wid_map_mu);
+
+	wid_map_write_begin ();
+	wid_map_table *t = wid_map.exchange (nullptr, std::memory_order_relaxed);
+	wid_map_write_end ();
+
+	while (t) {
+		wid_map_table *retired = t->retired;
+		delete[] t->slots;
+		delete t;
+		t = retired;
+	}
+
+	wid_map_live = 0;
 }
 
 VKFWwindow *
@@ -60,6 +284,59 @@ vkfwXcbAllocWindow (void)
 	return (VKFWwindow *) malloc (sizeof (VKFWxcbwindow));
 }
 
+/**
+ * Compute the X11 event mask for a window from its VKFW event mask, so that
+ * the server doesn't send us events that the application will never see.
+ * StructureNotify, FocusChange, VisibilityChange and PropertyChange are always
+ * selected, since we need them to track the window extent, the focus window
+ * and the visibility of the window.
+ */
+static uint32_t
+compute_x_event_mask (VKFWxcbwindow *w, uint32_t pointer_mode)
+{
+	uint32_t mask = w->window.event_mask;
+	uint32_t x_mask = XCB_EVENT_MASK_STRUCTURE_NOTIFY | XCB_EVENT_MASK_FOCUS_CHANGE
+		| XCB_EVENT_MASK_VISIBILITY_CHANGE | XCB_EVENT_MASK_PROPERTY_CHANGE;
+
+	if (mask & (VKFW_EVENT_BIT (VKFW_EVENT_KEY_PRESSED)
+			| VKFW_EVENT_BIT (VKFW_EVENT_KEY_RELEASED)
+			| VKFW_EVENT_BIT (VKFW_EVENT_TEXT_INPUT)))
+		x_mask |= XCB_EVENT_MASK_KEY_PRESS | XCB_EVENT_MASK_KEY_RELEASE;
+
+	if (mask & (VKFW_EVENT_BIT (VKFW_EVENT_BUTTON_PRESSED)
+			| VKFW_EVENT_BIT (VKFW_EVENT_BUTTON_RELEASED)
+			| VKFW_EVENT_BIT (VKFW_EVENT_SCROLL)))
+		x_mask |= XCB_EVENT_MASK_BUTTON_PRESS | XCB_EVENT_MASK_BUTTON_RELEASE;
+
+	/**
+	 * Without XInput2, relative motion is computed from MotionNotify.
+	 */
+	if (mask & VKFW_EVENT_BIT (VKFW_EVENT_POINTER_MOTION))
+		x_mask |= XCB_EVENT_MASK_POINTER_MOTION;
+	else if (!vkfw_has_xi2 && (pointer_mode & VKFW_POINTER_RELATIVE)
+			&& (mask & VKFW_EVENT_BIT (VKFW_EVENT_RELATIVE_POINTER_MOTION)))
+		x_mask |= XCB_EVENT_MASK_POINTER_MOTION;
+
+	return x_mask;
+}
+
+static void
+select_x_events (VKFWxcbwindow *w, uint32_t pointer_mode)
+{
+	uint32_t x_mask = compute_x_event_mask (w, pointer_mode);
+	if (x_mask == w->x_event_mask)
+		return;
+
+	vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: XID=%" PRIu32 " event mask %#" PRIx32 " -> %#" PRIx32 "\n",
+		w->wid, w->x_event_mask, x_mask);
+
+	uint32_t cw_values[] = { x_mask };
+	xcb_void_cookie_t cookie = xcb_change_window_attributes (vkfw_xcb_connection,
+		w->wid, XCB_CW_EVENT_MASK, cw_values);
+	vkfwXcbTrackRequest (cookie, "ChangeWindowAttributes(EventMask)", w);
+	w->x_event_mask = x_mask;
+}
+
 VkResult
 vkfwXcbCreateWindow (VKFWwindow *handle)
 {
@@ -70,6 +347,22 @@ vkfwXcbCreateWindow (VKFWwindow *handle)
 	w->warp_y = -1;
 	w->last_x = 0;
 	w->last_y = 0;
+	w->raw_x = 0;
+	w->raw_y = 0;
+	w->async_result = VK_SUCCESS;
+	w->mapped = false;
+	w->obscured = false;
+	w->net_wm_hidden = false;
+	w->net_wm_state_cookie.sequence = 0;
+	w->sync_counter = XCB_NONE;
+	w->sync_value = 0;
+	w->sync_requested = false;
+	w->sync_configured = false;
+	w->frame_counter = XCB_NONE;
+	w->frame_value = 0;
+	w->frame_requested = false;
+	w->has_frame_timings = false;
+	w->num_drawn_frames = 0;
 	w->wid = xcb_generate_id (vkfw_xcb_connection);
 	if (w->wid == -1)
 		return VK_ERROR_INITIALIZATION_FAILED;
@@ -79,43 +372,36 @@ vkfwXcbCreateWindow (VKFWwindow *handle)
 	if (!register_window_wid (w->wid, w))
 		return VK_ERROR_OUT_OF_HOST_MEMORY;
 
+	w->x_event_mask = compute_x_event_mask (w, 0);
+
+	VkExtent2D extent = handle->extent.load (std::memory_order_relaxed);
 	uint32_t cw_mask = XCB_CW_EVENT_MASK;
-	uint32_t cw_values[] = {
-		XCB_EVENT_MASK_KEY_PRESS | XCB_EVENT_MASK_KEY_RELEASE
-		| XCB_EVENT_MASK_BUTTON_PRESS | XCB_EVENT_MASK_BUTTON_RELEASE
-		| XCB_EVENT_MASK_POINTER_MOTION | XCB_EVENT_MASK_STRUCTURE_NOTIFY
-		| XCB_EVENT_MASK_FOCUS_CHANGE
-	};
-
-	xcb_void_cookie_t cookie = xcb_create_window_checked (vkfw_xcb_connection,
+	uint32_t cw_values[] = { w->x_event_mask };
+
+	xcb_void_cookie_t cookie = xcb_create_window (vkfw_xcb_connection,
 		XCB_COPY_FROM_PARENT, w->wid, w->parent,
-		0, 0, handle->extent.width, handle->extent.height, 0,
+		0, 0, extent.width, extent.height, 0,
 		XCB_WINDOW_CLASS_INPUT_OUTPUT,
 		vkfw_xcb_default_screen->root_visual, cw_mask, cw_values);
+	vkfwXcbTrackRequest (cookie, "CreateWindow", w);
 
-	if (vkfwXcbCheck (cookie)) {
-		unregister_window_wid (w->wid);
-		return VK_ERROR_INITIALIZATION_FAILED;
-	}
+	vkfwXcbCreateSyncCounter (w);
 
-	xcb_atom_t protocols[2];
+	xcb_atom_t protocols[3];
 	uint32_t num_protocols = 0;
 
 	if (vkfw__NET_WM_PING)
 		protocols[num_protocols++] = vkfw__NET_WM_PING;
 	if (vkfw_WM_DELETE_WINDOW)
 		protocols[num_protocols++] = vkfw_WM_DELETE_WINDOW;
+	if (w->sync_counter != XCB_NONE)
+		protocols[num_protocols++] = vkfw__NET_WM_SYNC_REQUEST;
 
 	if (vkfw_WM_PROTOCOLS) {
-		xcb_void_cookie_t protocols_cookie = xcb_change_property_checked (
-			vkfw_xcb_connection, XCB_PROP_MODE_REPLACE, w->wid,
-			vkfw_WM_PROTOCOLS, XCB_ATOM_ATOM, 32,
-			num_protocols, protocols);
-		if (vkfwXcbCheck (protocols_cookie)) {
-			unregister_window_wid (w->wid);
-			xcb_destroy_window (vkfw_xcb_connection, w->wid);
-			return VK_ERROR_INITIALIZATION_FAILED;
-		}
+		cookie = xcb_change_property (vkfw_xcb_connection,
+			XCB_PROP_MODE_REPLACE, w->wid, vkfw_WM_PROTOCOLS,
+			XCB_ATOM_ATOM, 32, num_protocols, protocols);
+		vkfwXcbTrackRequest (cookie, "ChangeProperty(WM_PROTOCOLS)", w);
 	}
 
 	return VK_SUCCESS;
@@ -129,8 +415,11 @@ vkfwXcbDestroyWindow (VKFWwindow *handle)
 	VKFWxcbwindow *w = (VKFWxcbwindow *) handle;
 	if (w == vkfw_xcb_focus_window)
 		vkfw_xcb_focus_window = nullptr;
+	if (vkfw_has_xi2 && (w->pointer_mode & VKFW_POINTER_RELATIVE))
+		vkfwXcbSelectRawMotion (false);
 	xcb_destroy_window (vkfw_xcb_connection, w->wid);
-	xcb_flush (vkfw_xcb_connection);
+	vkfwXcbDestroySyncCounter (w);
+	vkfwXcbForgetWindowRequests (w);
 	unregister_window_wid (w->wid);
 }
 
@@ -145,24 +434,33 @@ vkfwXcbCreateWindowSurface (VKFWwindow *handle, VkSurfaceKHR *out)
 	return vkCreateXcbSurfaceKHR (vkfwLoadedInstance, &ci, nullptr, out);
 }
 
+/**
+ * Errors for earlier requests on the window are reported by the next call to
+ * one of the functions below. These only make requests, so they don't take
+ * vkfw_input_mu.
+ */
+static VkResult
+take_async_result (VKFWxcbwindow *w)
+{
+	return w->async_result.exchange (VK_SUCCESS, std::memory_order_relaxed);
+}
+
 VkResult
 vkfwXcbShowWindow (VKFWwindow *handle)
 {
 	VKFWxcbwindow *w = (VKFWxcbwindow *) handle;
-	xcb_void_cookie_t cookie = xcb_map_window_checked (vkfw_xcb_connection, w->wid);
-	if (vkfwXcbCheck (cookie))
-		return VK_ERROR_UNKNOWN;
-	return VK_SUCCESS;
+	xcb_void_cookie_t cookie = xcb_map_window (vkfw_xcb_connection, w->wid);
+	vkfwXcbTrackRequest (cookie, "MapWindow", w);
+	return take_async_result (w);
 }
 
 VkResult
 vkfwXcbHideWindow (VKFWwindow *handle)
 {
 	VKFWxcbwindow *w = (VKFWxcbwindow *) handle;
-	xcb_void_cookie_t cookie = xcb_unmap_window_checked (vkfw_xcb_connection, w->wid);
-	if (vkfwXcbCheck (cookie))
-		return VK_ERROR_UNKNOWN;
-	return VK_SUCCESS;
+	xcb_void_cookie_t cookie = xcb_unmap_window (vkfw_xcb_connection, w->wid);
+	vkfwXcbTrackRequest (cookie, "UnmapWindow", w);
+	return take_async_result (w);
 }
 
 VkResult
@@ -171,31 +469,40 @@ vkfwXcbSetWindowTitle (VKFWwindow *handle, const char *title)
 	VKFWxcbwindow *w = (VKFWxcbwindow *) handle;
 	uint32_t n = strlen (title);
 
-	xcb_void_cookie_t cookie1 = xcb_change_property_checked (vkfw_xcb_connection,
+	xcb_void_cookie_t cookie = xcb_change_property (vkfw_xcb_connection,
 		XCB_PROP_MODE_REPLACE, w->wid, XCB_ATOM_WM_NAME,
 		XCB_ATOM_STRING, 8, n, title);
+	vkfwXcbTrackRequest (cookie, "ChangeProperty(WM_NAME)", w);
 
-	xcb_void_cookie_t cookie2 = xcb_change_property_checked (vkfw_xcb_connection,
+	cookie = xcb_change_property (vkfw_xcb_connection,
 		XCB_PROP_MODE_REPLACE, w->wid, XCB_ATOM_WM_ICON_NAME,
 		XCB_ATOM_STRING, 8, n, title);
+	vkfwXcbTrackRequest (cookie, "ChangeProperty(WM_ICON_NAME)", w);
 
-	bool failed = false;
-	failed |= vkfwXcbCheck (cookie1);
-	failed |= vkfwXcbCheck (cookie2);
-	if (failed)
-		return VK_ERROR_UNKNOWN;
-
-	return VK_SUCCESS;
+	return take_async_result (w);
 }
 
+/**
+ * The pointer mode and the X11 event mask are also used while translating
+ * events, so changing them takes vkfw_input_mu.
+ */
 void
 vkfwXcbUpdatePointerMode (VKFWwindow *handle)
 {
 	VKFWxcbwindow *w = (VKFWxcbwindow *) handle;
+	std::scoped_lock g (vkfw_input_mu);
 
-	uint32_t f = handle->pointer_flags;
+	uint32_t f = handle->pointer_flags.load (std::memory_order_relaxed);
 	uint32_t m = w->pointer_mode;
 
+	/**
+	 * With XInput2, the pointer is not warped back to the center of the
+	 * window in relative mode, so confine it to the window instead. This
+	 * keeps clicks and focus in the window, and raw motion keeps coming.
+	 */
+	if (vkfw_has_xi2 && (f & VKFW_POINTER_RELATIVE))
+		f |= VKFW_POINTER_CONFINED;
+
 	/**
 	 * CONFINED implies GRABBED.
 	 */
@@ -230,14 +537,32 @@ vkfwXcbUpdatePointerMode (VKFWwindow *handle)
 		xcb_ungrab_pointer (vkfw_xcb_connection, XCB_CURRENT_TIME);
 	}
 
-	if ((f & VKFW_POINTER_RELATIVE) && w->warp_x == -1 && w->warp_y == -1) {
-		w->warp_x = w->window.extent.width / 2;
-		w->warp_y = w->window.extent.height / 2;
+	if (vkfw_has_xi2) {
+		if ((f & VKFW_POINTER_RELATIVE) && !(m & VKFW_POINTER_RELATIVE)) {
+			w->raw_x = 0;
+			w->raw_y = 0;
+			vkfwXcbSelectRawMotion (true);
+		} else if (!(f & VKFW_POINTER_RELATIVE) && (m & VKFW_POINTER_RELATIVE))
+			vkfwXcbSelectRawMotion (false);
+	}
+
+	if ((f & VKFW_POINTER_RELATIVE) && !(m & VKFW_POINTER_RELATIVE)
+		&& w->warp_x == -1 && w->warp_y == -1) {
+		VkExtent2D extent = handle->extent.load (std::memory_order_relaxed);
+		w->warp_x = extent.width / 2;
+		w->warp_y = extent.height / 2;
 		xcb_warp_pointer (vkfw_xcb_connection, w->wid, w->wid, 0, 0,
-			w->window.extent.width, w->window.extent.height,
-			w->warp_x, w->warp_y);
+			extent.width, extent.height, w->warp_x, w->warp_y);
 	}
 
-	xcb_flush (vkfw_xcb_connection);
+	select_x_events (w, f);
 	w->pointer_mode = f;
 }
+
+void
+vkfwXcbUpdateEventMask (VKFWwindow *handle)
+{
+	VKFWxcbwindow *w = (VKFWxcbwindow *) handle;
+	std::scoped_lock g (vkfw_input_mu);
+	select_x_events (w, w->pointer_mode);
+}
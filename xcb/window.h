@@ -3,10 +3,17 @@
  * Copyright (C) 2024  dbstream
  */
 #include <VKFW/window.h>
+#include <xcb/sync.h>
 #include <xcb/xcb.h>
 
 typedef struct VKFWxcbwindow_T VKFWxcbwindow;
 
+/**
+ * The number of _NET_WM_FRAME_DRAWN messages that we remember while waiting
+ * for the _NET_WM_FRAME_TIMINGS of the same frames.
+ */
+#define VKFW_XCB_MAX_DRAWN_FRAMES 8
+
 extern VKFWxcbwindow *vkfw_xcb_focus_window;
 
 struct VKFWxcbwindow_T {
@@ -15,13 +22,81 @@ struct VKFWxcbwindow_T {
 	xcb_window_t parent;
 	uint32_t pointer_mode;
 
+	/**
+	 * The X11 event mask that is currently selected on wid.
+	 */
+	uint32_t x_event_mask;
+
+	/**
+	 * What we know about the visibility of the window: whether it is
+	 * mapped, fully obscured (VisibilityNotify), and whether the window
+	 * manager has set _NET_WM_STATE_HIDDEN on it. net_wm_state_cookie is
+	 * the pending request for _NET_WM_STATE, with sequence 0 if there is
+	 * none.
+	 */
+	bool mapped;
+	bool obscured;
+	bool net_wm_hidden;
+	xcb_get_property_cookie_t net_wm_state_cookie;
+
+	/**
+	 * _NET_WM_SYNC_REQUEST state, see wm_sync.cc. sync_counter is XCB_NONE
+	 * if the window doesn't take part in the protocol. sync_requested is
+	 * set when the window manager sends sync_value, and sync_configured
+	 * once the ConfigureNotify that it belongs to has been read; the
+	 * counter is then set by vkfwAckResize. This and the frame state
+	 * below are protected by the lock in wm_sync.cc.
+	 */
+	xcb_sync_counter_t sync_counter;
+	uint64_t sync_value;
+	bool sync_requested;
+	bool sync_configured;
+
+	/**
+	 * Extended frame sync state. frame_counter is XCB_NONE if the window
+	 * doesn't have the extended counter; frame_value is its value, odd
+	 * while a frame is being drawn. drawn_frames holds the frames from
+	 * _NET_WM_FRAME_DRAWN messages, oldest first, until the
+	 * _NET_WM_FRAME_TIMINGS with the same counter value completes them into
+	 * frame_timings.
+	 */
+	xcb_sync_counter_t frame_counter;
+	uint64_t frame_value;
+	bool frame_requested;
+	bool has_frame_timings;
+	uint32_t num_drawn_frames;
+	struct {
+		uint64_t frame;
+		uint64_t time;
+	} drawn_frames[VKFW_XCB_MAX_DRAWN_FRAMES];
+	VKFWframetimings frame_timings;
+
 	int last_x, last_y;
 	int warp_x, warp_y;
+
+	/**
+	 * Sub-pixel remainder of XI_RawMotion deltas, in 32.32 fixed point.
+	 */
+	int64_t raw_x, raw_y;
+
+	/**
+	 * The first error from an unchecked request on this window that was
+	 * not yet returned to the application. It is set while translating
+	 * events, and taken by the window functions on any thread.
+	 */
+	std::atomic<VkResult> async_result;
 };
 
+/**
+ * Map an XID to a window. This doesn't take any locks and can be called from
+ * any thread.
+ */
 VKFWxcbwindow *
 vkfwXcbXIDToWindow (xcb_window_t wid);
 
+void
+vkfwXcbFreeWindowMap (void);
+
 VKFWwindow *
 vkfwXcbAllocWindow (void);
 
@@ -45,3 +120,6 @@ vkfwXcbSetWindowTitle (VKFWwindow *handle, const char *title);
 
 void
 vkfwXcbUpdatePointerMode (VKFWwindow *handle);
+
+void
+vkfwXcbUpdateEventMask (VKFWwindow *handle);
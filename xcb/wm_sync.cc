@@ -0,0 +1,446 @@
+/**
+ * _NET_WM_SYNC_REQUEST and extended frame sync.
+ * Copyright (C) 2024  dbstream
+ */
+#include <VKFW/logging.h>
+#include <VKFW/options.h>
+#include <VKFW/platform.h>
+#include <VKFW/vkfw.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+#include "wm_sync.h"
+#include "window.h"
+#include "xcb.h"
+
+/**
+ * With _NET_WM_SYNC_REQUEST, the window manager doesn't resize a window again
+ * until the client has drawn the previous size. Before each ConfigureNotify
+ * during an interactive resize, the window manager sends a client message
+ * with a 64-bit value, and waits until the client sets its XSync counter to
+ * that value.
+ *
+ * We can't know when the application has drawn a frame, so the counter is
+ * set by vkfwAckResize. Because the window manager waits for every
+ * application that advertises the protocol, the application opts in with the
+ * xcb_sync_request option. Without it, sync requests are acknowledged as soon
+ * as the ConfigureNotify arrives.
+ *
+ * The extended frame sync protocol (the xcb_frame_timings option) adds a
+ * second counter to _NET_WM_SYNC_REQUEST_COUNTER, which the client makes odd
+ * while it draws a frame (vkfwBeginFrame) and even when the frame is done
+ * (vkfwEndFrame). After it has composited a finished frame, the compositor
+ * sends _NET_WM_FRAME_DRAWN, and later _NET_WM_FRAME_TIMINGS with when the
+ * frame is shown. Both carry the counter value of the frame. Timestamps are
+ * in microseconds on the compositor's monotonic clock, which is the clock
+ * of vkfwGetTime. Once a window has the extended counter, sync requests
+ * apply to it rather than to the basic counter. The window manager only sends
+ * frame messages to windows that advertise _NET_WM_SYNC_REQUEST, so it is
+ * also advertised for xcb_frame_timings.
+ *
+ * The sync and frame state of windows is used both while translating events
+ * and by the frame functions, which may be called on a render thread. It is
+ * protected by sync_mu rather than the input lock, so that a render thread
+ * never waits for a batch of events to be translated.
+ */
+
+bool vkfw_has_xsync;
+bool vkfw_xcb_sync_request;
+bool vkfw_xcb_frame_sync;
+
+static void *libxcb_sync_handle;
+
+static std::mutex sync_mu;
+
+static void
+unload_sync (void)
+{
+	vkfw_has_xsync = false;
+	vkfwCurrentPlatform->unloadModule (libxcb_sync_handle);
+}
+
+#define VKFW_SYNC_DEFINE_FUNC(name) PFN##name name;
+VKFW_XCB_SYNC_ALL_FUNCS(VKFW_SYNC_DEFINE_FUNC)
+#undef VKFW_SYNC_DEFINE_FUNC
+
+static void
+load_sync (void)
+{
+	libxcb_sync_handle = vkfwCurrentPlatform->loadModule ("libxcb-sync.so.1");
+	if (!libxcb_sync_handle)
+		libxcb_sync_handle = vkfwCurrentPlatform->loadModule ("libxcb-sync.so");
+	if (!libxcb_sync_handle) {
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: libxcb-sync is not present\n");
+		return;
+	}
+
+	bool failed = false;
+#define VKFW_SYNC_LOAD_FUNC(name)								\
+	name = (PFN##name) vkfwCurrentPlatform->lookupSymbol (libxcb_sync_handle, #name);	\
+	if (!name)										\
+		failed = true;
+	VKFW_XCB_SYNC_ALL_FUNCS(VKFW_SYNC_LOAD_FUNC)
+#undef VKFW_SYNC_LOAD_FUNC
+
+	if (failed) {
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: failed to load some libxcb-sync symbols\n");
+		unload_sync ();
+		return;
+	}
+
+	vkfw_has_xsync = true;
+}
+
+static bool
+setup_sync (void)
+{
+	static const char name[] = "SYNC";
+
+	/**
+	 * libxcb shuts the connection down if we make a request to an
+	 * extension that the server doesn't have, so check that it is present
+	 * first.
+	 */
+	xcb_query_extension_reply_t *ext = xcb_query_extension_reply (vkfw_xcb_connection,
+		xcb_query_extension (vkfw_xcb_connection, strlen (name), name), nullptr);
+	bool present = ext && ext->present;
+	free (ext);
+	if (!present)
+		return false;
+
+	/**
+	 * The server must know our version of the extension before we can
+	 * make any other requests.
+	 */
+	xcb_sync_initialize_reply_t *version = xcb_sync_initialize_reply (vkfw_xcb_connection,
+		xcb_sync_initialize (vkfw_xcb_connection, 3, 1), nullptr);
+	if (!version)
+		return false;
+
+	vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: XSync %" PRIu8 ".%" PRIu8 "\n",
+		version->major_version, version->minor_version);
+	free (version);
+	return true;
+}
+
+void
+vkfwXcbInitSync (void)
+{
+	bool want_sync_request = vkfwGetBool ("xcb_sync_request");
+	bool want_frame_sync = vkfwGetBool ("xcb_frame_timings");
+	if (!want_sync_request && !want_frame_sync)
+		return;
+
+	if (!vkfw__NET_WM_SYNC_REQUEST_COUNTER) {
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: _NET_WM_SYNC_REQUEST_COUNTER is not available\n");
+		return;
+	}
+
+	load_sync ();
+	if (vkfw_has_xsync && !setup_sync ())
+		unload_sync ();
+
+	if (!vkfw_has_xsync) {
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: XSync is not available. _NET_WM_SYNC_REQUEST will not be used\n");
+		return;
+	}
+
+	if (!vkfw__NET_WM_SYNC_REQUEST) {
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: _NET_WM_SYNC_REQUEST is not available\n");
+		return;
+	}
+
+	vkfw_xcb_sync_request = want_sync_request;
+	vkfw_xcb_frame_sync = want_frame_sync && vkfw__NET_WM_FRAME_DRAWN
+		&& vkfw__NET_WM_FRAME_TIMINGS;
+
+	if (vkfw_xcb_sync_request)
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: using _NET_WM_SYNC_REQUEST for interactive resizing\n");
+	if (vkfw_xcb_frame_sync)
+		vkfwPrintf (VKFW_LOG_BACKEND, "VKFW: Xcb: using _NET_WM_FRAME_DRAWN and _NET_WM_FRAME_TIMINGS\n");
+}
+
+void
+vkfwXcbTerminateSync (void)
+{
+	vkfw_xcb_sync_request = false;
+	vkfw_xcb_frame_sync = false;
+	if (vkfw_has_xsync)
+		unload_sync ();
+}
+
+static xcb_sync_counter_t
+create_counter (VKFWxcbwindow *w)
+{
+	xcb_sync_counter_t counter = xcb_generate_id (vkfw_xcb_connection);
+	if (counter == (xcb_sync_counter_t) -1)
+		return XCB_NONE;
+
+	xcb_sync_int64_t initial = { 0, 0 };
+	xcb_void_cookie_t cookie = xcb_sync_create_counter (vkfw_xcb_connection,
+		counter, initial);
+	vkfwXcbTrackRequest (cookie, "SyncCreateCounter", w);
+	return counter;
+}
+
+static void
+set_counter (VKFWxcbwindow *w, xcb_sync_counter_t counter, uint64_t v)
+{
+	xcb_sync_int64_t value;
+	value.hi = (int32_t) (v >> 32);
+	value.lo = (uint32_t) v;
+
+	xcb_void_cookie_t cookie = xcb_sync_set_counter (vkfw_xcb_connection,
+		counter, value);
+	vkfwXcbTrackRequest (cookie, "SyncSetCounter", w);
+}
+
+void
+vkfwXcbCreateSyncCounter (VKFWxcbwindow *w)
+{
+	if (!vkfw_xcb_sync_request && !vkfw_xcb_frame_sync)
+		return;
+
+	xcb_sync_counter_t counters[2];
+	uint32_t num_counters = 0;
+
+	counters[0] = create_counter (w);
+	if (counters[0] == XCB_NONE)
+		return;
+	num_counters++;
+
+	if (vkfw_xcb_frame_sync) {
+		counters[1] = create_counter (w);
+		if (counters[1] != XCB_NONE)
+			num_counters++;
+	}
+
+	xcb_void_cookie_t cookie = xcb_change_property (vkfw_xcb_connection,
+		XCB_PROP_MODE_REPLACE, w->wid, vkfw__NET_WM_SYNC_REQUEST_COUNTER,
+		XCB_ATOM_CARDINAL, 32, num_counters, counters);
+	vkfwXcbTrackRequest (cookie, "ChangeProperty(_NET_WM_SYNC_REQUEST_COUNTER)", w);
+
+	w->sync_counter = counters[0];
+	if (num_counters > 1)
+		w->frame_counter = counters[1];
+}
+
+void
+vkfwXcbDestroySyncCounter (VKFWxcbwindow *w)
+{
+	if (w->frame_counter != XCB_NONE) {
+		xcb_sync_destroy_counter (vkfw_xcb_connection, w->frame_counter);
+		w->frame_counter = XCB_NONE;
+	}
+
+	if (w->sync_counter != XCB_NONE) {
+		xcb_sync_destroy_counter (vkfw_xcb_connection, w->sync_counter);
+		w->sync_counter = XCB_NONE;
+	}
+}
+
+void
+vkfwXcbHandleSyncRequest (VKFWxcbwindow *w, xcb_client_message_event_t *xe)
+{
+	std::scoped_lock g (sync_mu);
+	if (w->sync_counter == XCB_NONE)
+		return;
+
+	w->sync_value = ((uint64_t) xe->data.data32[3] << 32) | xe->data.data32[2];
+	w->sync_requested = true;
+}
+
+/**
+ * With the extended counter, the acknowledgement is the first frame value
+ * that is at least sync_value. If a frame is being drawn, vkfwEndFrame will
+ * make the counter even.
+ */
+static void
+ack_sync_request (VKFWxcbwindow *w)
+{
+	w->sync_configured = false;
+
+	if (w->frame_counter == XCB_NONE) {
+		set_counter (w, w->sync_counter, w->sync_value);
+		return;
+	}
+
+	bool in_frame = w->frame_value & 1;
+	uint64_t v = (w->sync_value + 1) & ~(uint64_t) 1;
+	if (in_frame)
+		v++;
+
+	if (v > w->frame_value) {
+		w->frame_value = v;
+		set_counter (w, w->frame_counter, v);
+	}
+}
+
+void
+vkfwXcbSyncConfigure (VKFWxcbwindow *w)
+{
+	std::scoped_lock g (sync_mu);
+	if (!w->sync_requested)
+		return;
+
+	w->sync_requested = false;
+	w->sync_configured = true;
+
+	/**
+	 * An application that doesn't look at RESIZE_NOTIFY, or that only
+	 * asked for frame timings, will never call vkfwAckResize, so don't
+	 * make the window manager wait for it.
+	 */
+	if (!vkfw_xcb_sync_request
+		|| !(w->window.event_mask & VKFW_EVENT_BIT (VKFW_EVENT_WINDOW_RESIZE_NOTIFY)))
+		ack_sync_request (w);
+}
+
+void
+vkfwXcbAckResize (VKFWwindow *handle)
+{
+	VKFWxcbwindow *w = (VKFWxcbwindow *) handle;
+	{
+		std::scoped_lock g (sync_mu);
+		if (!w->sync_configured)
+			return;
+
+		ack_sync_request (w);
+	}
+
+	/**
+	 * The window manager is waiting for this, so send it right away
+	 * rather than with the next batch of events.
+	 */
+	xcb_flush (vkfw_xcb_connection);
+}
+
+void
+vkfwXcbBeginFrame (VKFWwindow *handle)
+{
+	VKFWxcbwindow *w = (VKFWxcbwindow *) handle;
+	{
+		std::scoped_lock g (sync_mu);
+		if (w->frame_counter == XCB_NONE || (w->frame_value & 1))
+			return;
+
+		set_counter (w, w->frame_counter, ++w->frame_value);
+	}
+	xcb_flush (vkfw_xcb_connection);
+}
+
+uint64_t
+vkfwXcbEndFrame (VKFWwindow *handle)
+{
+	VKFWxcbwindow *w = (VKFWxcbwindow *) handle;
+	uint64_t v;
+	{
+		std::scoped_lock g (sync_mu);
+		if (w->frame_counter == XCB_NONE)
+			return 0;
+
+		if (!(w->frame_value & 1))
+			return w->frame_value;
+
+		v = ++w->frame_value;
+		set_counter (w, w->frame_counter, v);
+	}
+	xcb_flush (vkfw_xcb_connection);
+	return v;
+}
+
+VkResult
+vkfwXcbRequestFrame (VKFWwindow *handle)
+{
+	VKFWxcbwindow *w = (VKFWxcbwindow *) handle;
+	std::scoped_lock g (sync_mu);
+	if (w->frame_counter == XCB_NONE)
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+
+	w->frame_requested = true;
+	return VK_SUCCESS;
+}
+
+void
+vkfwXcbHandleFrameDrawn (VKFWevent *e, VKFWxcbwindow *w, xcb_client_message_event_t *xe)
+{
+	std::scoped_lock g (sync_mu);
+	if (w->frame_counter == XCB_NONE)
+		return;
+
+	/**
+	 * The compositor may draw several frames before it knows when the
+	 * first of them is shown. If it never sends the timings of a frame,
+	 * forget the oldest one.
+	 */
+	if (w->num_drawn_frames == VKFW_XCB_MAX_DRAWN_FRAMES) {
+		w->num_drawn_frames--;
+		memmove (&w->drawn_frames[0], &w->drawn_frames[1],
+			w->num_drawn_frames * sizeof (w->drawn_frames[0]));
+	}
+
+	uint32_t i = w->num_drawn_frames++;
+	w->drawn_frames[i].frame = ((uint64_t) xe->data.data32[1] << 32) | xe->data.data32[0];
+	w->drawn_frames[i].time = ((uint64_t) xe->data.data32[3] << 32) | xe->data.data32[2];
+
+	/**
+	 * The compositor has used the frame, so this is the time to start
+	 * drawing the next one.
+	 */
+	if (w->frame_requested) {
+		w->frame_requested = false;
+		e->type = VKFW_EVENT_FRAME_READY;
+		e->window = (VKFWwindow *) w;
+	}
+}
+
+void
+vkfwXcbHandleFrameTimings (VKFWxcbwindow *w, xcb_client_message_event_t *xe)
+{
+	std::scoped_lock g (sync_mu);
+	if (w->frame_counter == XCB_NONE)
+		return;
+
+	uint64_t frame = ((uint64_t) xe->data.data32[1] << 32) | xe->data.data32[0];
+	uint32_t i = 0;
+	while (i < w->num_drawn_frames && w->drawn_frames[i].frame != frame)
+		i++;
+	if (i == w->num_drawn_frames)
+		return;
+
+	/**
+	 * Timings arrive in the order that frames were drawn, so the frames
+	 * before this one will never get theirs.
+	 */
+	uint64_t drawn_time = w->drawn_frames[i].time;
+	w->num_drawn_frames -= i + 1;
+	memmove (&w->drawn_frames[0], &w->drawn_frames[i + 1],
+		w->num_drawn_frames * sizeof (w->drawn_frames[0]));
+
+	/**
+	 * The presentation time is relative to the time the frame was drawn,
+	 * and may be negative. 0 means unknown, for both fields.
+	 */
+	int32_t presentation_offset = (int32_t) xe->data.data32[2];
+	uint32_t refresh_interval = xe->data.data32[3];
+
+	VKFWframetimings *t = &w->frame_timings;
+	t->frame = frame;
+	t->drawn = drawn_time;
+	t->presented = presentation_offset ? drawn_time + presentation_offset : 0;
+	t->refresh = refresh_interval;
+	w->has_frame_timings = true;
+}
+
+bool
+vkfwXcbGetFrameTimings (VKFWwindow *handle, VKFWframetimings *timings)
+{
+	VKFWxcbwindow *w = (VKFWxcbwindow *) handle;
+	std::scoped_lock g (sync_mu);
+	if (!w->has_frame_timings)
+		return false;
+
+	*timings = w->frame_timings;
+	return true;
+}
@@ -0,0 +1,81 @@
+/**
+ * _NET_WM_SYNC_REQUEST and extended frame sync
+ * Copyright (C) 2024  dbstream
+ */
+
+#include "xcb_sync.h"
+#include <VKFW/vkfw.h>
+#include <xcb/xcb.h>
+
+typedef struct VKFWxcbwindow_T VKFWxcbwindow;
+
+/**
+ * Load libxcb-sync if the xcb_sync_request or xcb_frame_timings option is
+ * set.
+ */
+void
+vkfwXcbInitSync (void);
+
+void
+vkfwXcbTerminateSync (void);
+
+extern bool vkfw_has_xsync;
+
+/**
+ * Whether windows take part in _NET_WM_SYNC_REQUEST, and whether they have
+ * the extended frame counter.
+ */
+extern bool vkfw_xcb_sync_request;
+extern bool vkfw_xcb_frame_sync;
+
+/**
+ * Create the XSync counters of a window and set _NET_WM_SYNC_REQUEST_COUNTER
+ * on it. On failure, the window doesn't take part in the protocols.
+ */
+void
+vkfwXcbCreateSyncCounter (VKFWxcbwindow *w);
+
+void
+vkfwXcbDestroySyncCounter (VKFWxcbwindow *w);
+
+/**
+ * Handle a _NET_WM_SYNC_REQUEST message. The request applies to the next
+ * ConfigureNotify for the window.
+ */
+void
+vkfwXcbHandleSyncRequest (VKFWxcbwindow *w, xcb_client_message_event_t *xe);
+
+/**
+ * Called for every ConfigureNotify, before the RESIZE_NOTIFY event for it is
+ * sent.
+ */
+void
+vkfwXcbSyncConfigure (VKFWxcbwindow *w);
+
+/**
+ * Handle _NET_WM_FRAME_DRAWN. This fills in a VKFW_EVENT_FRAME_READY event
+ * if a frame callback was requested for the window.
+ */
+void
+vkfwXcbHandleFrameDrawn (VKFWevent *e, VKFWxcbwindow *w, xcb_client_message_event_t *xe);
+
+void
+vkfwXcbHandleFrameTimings (VKFWxcbwindow *w, xcb_client_message_event_t *xe);
+
+/**
+ * Backend hooks.
+ */
+void
+vkfwXcbAckResize (VKFWwindow *handle);
+
+void
+vkfwXcbBeginFrame (VKFWwindow *handle);
+
+uint64_t
+vkfwXcbEndFrame (VKFWwindow *handle);
+
+bool
+vkfwXcbGetFrameTimings (VKFWwindow *handle, VKFWframetimings *timings);
+
+VkResult
+vkfwXcbRequestFrame (VKFWwindow *handle);
@@ -3,22 +3,79 @@
  * Copyright (C) 2024  dbstream
  */
 #include <xcb/xcb.h>
+#include <xcb/xcbext.h>
 
 extern xcb_connection_t *vkfw_xcb_connection;
 extern xcb_screen_t *vkfw_xcb_default_screen;
 
 extern xcb_cursor_t vkfw_xcb_cursors[];
 
+typedef struct VKFWxcbwindow_T VKFWxcbwindow;
+
+/**
+ * Wait for the result of a checked request. This is a round trip to the X
+ * server; only use it during initialization.
+ */
 bool
 vkfwXcbCheck (xcb_void_cookie_t cookie);
 
+/**
+ * Remember an unchecked request, so that an error for it can be reported
+ * with context. If window is not nullptr, the error is also recorded in
+ * window->async_result.
+ */
+void
+vkfwXcbTrackRequest (xcb_void_cookie_t cookie, const char *what,
+	VKFWxcbwindow *window);
+
+/**
+ * Called for every event with its sequence number.
+ */
+void
+vkfwXcbRetireRequests (uint32_t sequence);
+
+/**
+ * Called with the reply to a tracked request, or with nullptr if the request
+ * failed. The reply is freed afterwards.
+ */
+typedef void (*VKFWxcbreplyhandler) (VKFWxcbwindow *window, uint32_t sequence,
+	void *reply);
+
+/**
+ * Remember a request that has a reply, so that handler is called when the
+ * reply arrives instead of waiting for it. Replies are picked up by
+ * vkfwXcbPollReplies.
+ */
+void
+vkfwXcbTrackReply (uint32_t sequence, VKFWxcbwindow *window,
+	VKFWxcbreplyhandler handler);
+
+/**
+ * Call the handlers of tracked requests whose replies have already been read
+ * from the connection. This never reads from the socket.
+ */
+void
+vkfwXcbPollReplies (void);
+
+void
+vkfwXcbForgetWindowRequests (VKFWxcbwindow *window);
+
+void
+vkfwXcbHandleError (xcb_generic_error_t *e);
+
 #define VKFW_XCB_CURSOR_NORMAL 0
 #define VKFW_XCB_CURSOR_HIDDEN 1
 
 #define VKFW_XCB_ALL_ATOMS(macro)		\
 	macro(WM_PROTOCOLS)			\
 	macro(WM_DELETE_WINDOW)			\
-	macro(_NET_WM_PING)
+	macro(_NET_WM_PING)			\
+	macro(_NET_WM_SYNC_REQUEST)		\
+	macro(_NET_WM_SYNC_REQUEST_COUNTER)	\
+	macro(_NET_WM_FRAME_DRAWN)		\
+	macro(_NET_WM_FRAME_TIMINGS)		\
+	macro(_NET_WM_STATE)			\
+	macro(_NET_WM_STATE_HIDDEN)
 
 #define VKFW_DECLARE_ATOM(name) extern xcb_atom_t vkfw_##name;
 VKFW_XCB_ALL_ATOMS(VKFW_DECLARE_ATOM)
@@ -30,6 +87,8 @@ macro(xcb_disconnect)			\
 macro(xcb_get_setup)			\
 macro(xcb_generate_id)			\
 macro(xcb_request_check)		\
+macro(xcb_poll_for_reply)		\
+macro(xcb_discard_reply)		\
 macro(xcb_wait_for_event)		\
 macro(xcb_poll_for_event)		\
 macro(xcb_poll_for_queued_event)	\
@@ -38,14 +97,21 @@ macro(xcb_flush)			\
 macro(xcb_connection_has_error)		\
 macro(xcb_setup_roots_iterator)		\
 macro(xcb_screen_next)			\
+macro(xcb_create_window)		\
 macro(xcb_create_window_checked)	\
 macro(xcb_destroy_window)		\
-macro(xcb_map_window_checked)		\
-macro(xcb_unmap_window_checked)		\
-macro(xcb_change_property_checked)	\
+macro(xcb_map_window)			\
+macro(xcb_unmap_window)		\
+macro(xcb_change_property)		\
+macro(xcb_get_property)			\
+macro(xcb_get_property_reply)		\
+macro(xcb_get_property_value)		\
+macro(xcb_get_property_value_length)	\
 macro(xcb_intern_atom)			\
 macro(xcb_intern_atom_reply)		\
-macro(xcb_send_event_checked)		\
+macro(xcb_query_extension)		\
+macro(xcb_query_extension_reply)	\
+macro(xcb_send_event)			\
 macro(xcb_create_cursor_checked)	\
 macro(xcb_free_cursor)			\
 macro(xcb_free_pixmap)			\
@@ -70,6 +136,8 @@ VKFW_XCB_ALL_FUNCS(VKFW_XCB_DEFINE_FUNC)
 #define xcb_get_setup vkfw_xcb_get_setup
 #define xcb_generate_id vkfw_xcb_generate_id
 #define xcb_request_check vkfw_xcb_request_check
+#define xcb_poll_for_reply vkfw_xcb_poll_for_reply
+#define xcb_discard_reply vkfw_xcb_discard_reply
 #define xcb_wait_for_event vkfw_xcb_wait_for_event
 #define xcb_poll_for_event vkfw_xcb_poll_for_event
 #define xcb_poll_for_queued_event vkfw_xcb_poll_for_queued_event
@@ -78,14 +146,21 @@ VKFW_XCB_ALL_FUNCS(VKFW_XCB_DEFINE_FUNC)
 #define xcb_connection_has_error vkfw_xcb_connection_has_error
 #define xcb_setup_roots_iterator vkfw_xcb_setup_roots_iterator
 #define xcb_screen_next vkfw_xcb_screen_next
+#define xcb_create_window vkfw_xcb_create_window
 #define xcb_create_window_checked vkfw_xcb_create_window_checked
 #define xcb_destroy_window vkfw_xcb_destroy_window
-#define xcb_map_window_checked vkfw_xcb_map_window_checked
-#define xcb_unmap_window_checked vkfw_xcb_unmap_window_checked
-#define xcb_change_property_checked vkfw_xcb_change_property_checked
+#define xcb_map_window vkfw_xcb_map_window
+#define xcb_unmap_window vkfw_xcb_unmap_window
+#define xcb_change_property vkfw_xcb_change_property
+#define xcb_get_property vkfw_xcb_get_property
+#define xcb_get_property_reply vkfw_xcb_get_property_reply
+#define xcb_get_property_value vkfw_xcb_get_property_value
+#define xcb_get_property_value_length vkfw_xcb_get_property_value_length
 #define xcb_intern_atom vkfw_xcb_intern_atom
 #define xcb_intern_atom_reply vkfw_xcb_intern_atom_reply
-#define xcb_send_event_checked vkfw_xcb_send_event_checked
+#define xcb_query_extension vkfw_xcb_query_extension
+#define xcb_query_extension_reply vkfw_xcb_query_extension_reply
+#define xcb_send_event vkfw_xcb_send_event
 #define xcb_create_cursor_checked vkfw_xcb_create_cursor_checked
 #define xcb_free_cursor vkfw_xcb_free_cursor
 #define xcb_free_pixmap vkfw_xcb_free_pixmap
@@ -0,0 +1,29 @@
+/**
+ * libxcb-sync functions
+ * Copyright (C) 2024  dbstream
+ */
+#ifndef VKFW_XCB_SYNC_H
+#define VKFW_XCB_SYNC_H 1
+
+#include <xcb/sync.h>
+
+#define VKFW_XCB_SYNC_ALL_FUNCS(macro)		\
+macro(xcb_sync_initialize)			\
+macro(xcb_sync_initialize_reply)		\
+macro(xcb_sync_create_counter)			\
+macro(xcb_sync_destroy_counter)			\
+macro(xcb_sync_set_counter)
+
+#define VKFW_XCB_SYNC_DEFINE_FUNC(name)	\
+typedef decltype(&name) PFN##name;	\
+extern PFN##name vkfw_##name;
+VKFW_XCB_SYNC_ALL_FUNCS(VKFW_XCB_SYNC_DEFINE_FUNC)
+#undef VKFW_XCB_SYNC_DEFINE_FUNC
+
+#define xcb_sync_initialize vkfw_xcb_sync_initialize
+#define xcb_sync_initialize_reply vkfw_xcb_sync_initialize_reply
+#define xcb_sync_create_counter vkfw_xcb_sync_create_counter
+#define xcb_sync_destroy_counter vkfw_xcb_sync_destroy_counter
+#define xcb_sync_set_counter vkfw_xcb_sync_set_counter
+
+#endif /* VKFW_XCB_SYNC_H */
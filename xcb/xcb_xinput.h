@@ -0,0 +1,29 @@
+/**
+ * libxcb-xinput functions
+ * Copyright (C) 2024  dbstream
+ */
+#ifndef VKFW_XCB_XINPUT_H
+#define VKFW_XCB_XINPUT_H 1
+
+#include <xcb/xinput.h>
+
+#define VKFW_XCB_XINPUT_ALL_FUNCS(macro)		\
+macro(xcb_input_xi_query_version)			\
+macro(xcb_input_xi_query_version_reply)			\
+macro(xcb_input_xi_select_events)			\
+macro(xcb_input_raw_button_press_valuator_mask)		\
+macro(xcb_input_raw_button_press_axisvalues_raw)
+
+#define VKFW_XCB_XINPUT_DEFINE_FUNC(name)	\
+typedef decltype(&name) PFN##name;		\
+extern PFN##name vkfw_##name;
+VKFW_XCB_XINPUT_ALL_FUNCS(VKFW_XCB_XINPUT_DEFINE_FUNC)
+#undef VKFW_XCB_XINPUT_DEFINE_FUNC
+
+#define xcb_input_xi_query_version vkfw_xcb_input_xi_query_version
+#define xcb_input_xi_query_version_reply vkfw_xcb_input_xi_query_version_reply
+#define xcb_input_xi_select_events vkfw_xcb_input_xi_select_events
+#define xcb_input_raw_button_press_valuator_mask vkfw_xcb_input_raw_button_press_valuator_mask
+#define xcb_input_raw_button_press_axisvalues_raw vkfw_xcb_input_raw_button_press_axisvalues_raw
+
+#endif /* VKFW_XCB_XINPUT_H */